@@ -5,8 +5,11 @@
 /**
   * Initialize the stack of a process in such a way that it can be read
   * from the transfer function.
-  * First element should be the return address.
-  * The last element is the interrupt switch status. We initialize it to 1.
+  * The initial frame is a cooperative frame (see _ctransfer) that returns
+  * to _startProcess with r16 = entry point and r17 = exit routine, so
+  * either switch path can start it.
+  * The last element is the interrupt switch status. We initialize it to 0:
+  * _startProcess allows interrupts.
   * A pointer to the stack pointer is returned.
   */
 .global _createStack
@@ -14,23 +17,46 @@
 _createStack: #r4 = newSP
 			  #r5 = newPC
 			  #r6 = stackSize - 4
+			  #r7 = exitPC
 	   # pointer to the bottom of the stack
 	   add r2, r4, r6
 	   # init sp with r8
-	   addi r8, r2, -100 # sp
-	   stw  r5, 0(r8)   # sp[0] = PC
-	   addi r9, r0, 1
-	   stw  r9, 96(r8)  # sp[24] = status = 1
-	   # store sp on the stack bottom
-	   stw  r8, 0(r2)
+	   addi r8, r2, -44 # sp
+	   movia r9, _startProcess
+	   stw  r9, 0(r8)   # sp[0] = ra = _startProcess
+	   stw  r5, 8(r8)   # sp[2] = r16 = PC
+	   stw  r7, 12(r8)  # sp[3] = r17 = exit routine
+	   stw  r0, 40(r8)  # sp[10] = status = 0
+	   # store sp on the stack bottom, tagged as a cooperative frame
+	   addi r9, r8, 1
+	   stw  r9, 0(r2)
 	   # return pointer to stack address
 	   ret
 
+/**
+ * First code run by a process: allow interrupts through allowInterrupts,
+ * which ends the masked window of the switch (IRQ_LATENCY), then call its
+ * function, then the exit routine if the function returns.
+ */
+_startProcess:
+	call  allowInterrupts
+	callr r16
+	callr r17
+_startProcessHalt:
+	br _startProcessHalt
+
 /**
  * Context switch called from either a normal context or from an interrupt routine.
  * For those reason every registers and interrupt switch status *must* be saved.
  * We use bret instruction instead of ret at the to do restore the status.
  * (eret instruction retores estatus into status register, while jumping at ea)
+ *
+ * The saved sp has bit 0 clear for such a full frame and set for a
+ * cooperative frame saved by _ctransfer; _restore resumes either kind.
+ *
+ * In the SMP build (assembled with --defsym=SMP=1), running and nextP are
+ * CORE_LOCAL: they live in the .core_local memory of each core, out of
+ * reach of gp, and are addressed absolutely.
  */
 .global _transfer
 .text
@@ -64,13 +90,29 @@ _transfer:
     rdctl r2, status
     stw   r2, 96(sp)
     # running->sp = sp
+.ifdef SMP
+    movia r3, running
+    ldw r2, (r3)
+.else
     ldw r2, %gprel(running)(gp)
+.endif
     stw sp, (r2)
+
+_restore:
     # running = nextP
+.ifdef SMP
+	movia r3, nextP
+	ldw r2, (r3)
+	movia r3, running
+	stw r2, (r3)
+.else
 	ldw r2, %gprel(nextP)(gp)
 	stw r2, %gprel(running)(gp)
+.endif
 	# set sp to the sp from the nextP
 	ldw sp, (r2)
+	andi r3, sp, 1
+	bne  r3, r0, _restoreCooperative
 	# return using bret -> ba
 	ldw ba,  0(sp)
     ldw fp,  4(sp)
@@ -104,21 +146,149 @@ _transfer:
 	# bret will copy back bstatus into status and go to ba
 	bret
 
+_restoreCooperative:
+	addi sp, sp, -1
+	ldw ra,  0(sp)
+    ldw fp,  4(sp)
+    ldw r16, 8(sp)
+    ldw r17, 12(sp)
+    ldw r18, 16(sp)
+    ldw r19, 20(sp)
+    ldw r20, 24(sp)
+    ldw r21, 28(sp)
+    ldw r22, 32(sp)
+    ldw r23, 36(sp)
+    ldw r2,  40(sp)
+	addi sp, sp, 44
+	# restore interrupt switch status and return
+	wrctl status, r2
+	ret
+
+/**
+ * Cooperative context switch, for a process that blocks in a kernel call.
+ * It is an ordinary function call, so only the callee saved registers
+ * (r16-r23, fp, ra) and the interrupt switch status need to be kept:
+ * 44 bytes instead of the 100 byte frame of _transfer.
+ */
+.global _ctransfer
+.text
+_ctransfer:
+	addi sp, sp, -44
+	stw ra,  0(sp)
+    stw fp,  4(sp)
+    stw r16, 8(sp)
+    stw r17, 12(sp)
+    stw r18, 16(sp)
+    stw r19, 20(sp)
+    stw r20, 24(sp)
+    stw r21, 28(sp)
+    stw r22, 32(sp)
+    stw r23, 36(sp)
+    rdctl r2, status
+    stw   r2, 40(sp)
+    # running->sp = sp, tagged as a cooperative frame
+.ifdef SMP
+    movia r3, running
+    ldw  r2, (r3)
+.else
+    ldw  r2, %gprel(running)(gp)
+.endif
+    addi r3, sp, 1
+    stw  r3, (r2)
+    br   _restore
+
 
+/**
+ * Interrupt switch. Built with IRQ_LATENCY (assembled with
+ * --defsym=IRQ_LATENCY=1), masking interrupts that were allowed calls
+ * irq_masked_begin once they are masked, and allowing them calls
+ * irq_masked_end while they still are.
+ */
 .global maskInterrupts
 .text
 maskInterrupts:
-	addi r9, r0, 0
-	wrctl status, r9
+	rdctl r9, status
+	movi r10, -2
+	and r10, r9, r10
+	wrctl status, r10
+.ifdef IRQ_LATENCY
+	andi r9, r9, 1
+	beq  r9, r0, 1f
+	jmpi irq_masked_begin
+1:
+.endif
 	ret
 
 .global allowInterrupts
 .text
 allowInterrupts:
-	addi r9, r0, 1
+.ifdef IRQ_LATENCY
+	rdctl r9, status
+	andi r9, r9, 1
+	bne  r9, r0, 1f
+	addi sp, sp, -4
+	stw  ra, 0(sp)
+	call irq_masked_end
+	ldw  ra, 0(sp)
+	addi sp, sp, 4
+1:
+.endif
+	rdctl r9, status
+	ori r9, r9, 1
 	wrctl status, r9
 	ret
 
+.global saveInterrupts
+.text
+saveInterrupts:
+	rdctl r2, status
+	movi r3, -2
+	and r3, r2, r3
+	wrctl status, r3
+.ifdef IRQ_LATENCY
+	andi r3, r2, 1
+	beq  r3, r0, 1f
+	addi sp, sp, -8
+	stw  ra, 0(sp)
+	stw  r2, 4(sp)
+	call irq_masked_begin
+	ldw  r2, 4(sp)
+	ldw  ra, 0(sp)
+	addi sp, sp, 8
+1:
+.endif
+	ret
+
+.global restoreInterrupts
+.text
+restoreInterrupts:
+.ifdef IRQ_LATENCY
+	andi r9, r4, 1
+	beq  r9, r0, 1f
+	rdctl r9, status
+	andi r9, r9, 1
+	bne  r9, r0, 1f
+	addi sp, sp, -8
+	stw  ra, 0(sp)
+	stw  r4, 4(sp)
+	call irq_masked_end
+	ldw  r4, 4(sp)
+	ldw  ra, 0(sp)
+	addi sp, sp, 8
+1:
+.endif
+	wrctl status, r4
+	ret
+
+/**
+ * Nios II has no instruction to wait for an interrupt: the idle loop
+ * simply spins until one arrives.
+ */
+.global waitForInterrupt
+.text
+waitForInterrupt:
+	ret
+
 .end
 
 
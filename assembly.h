@@ -4,7 +4,8 @@
 #include "system_m.h"
 
 void _transfer();
-Process _createStack(unsigned int* newSP,unsigned int* newPC,int stackSize);
+void _ctransfer();
+Process _createStack(unsigned int* newSP,unsigned int* newPC,int stackSize,unsigned int* exitPC);
 
 
 #endif /*ASSEMBLY_H_*/
@@ -0,0 +1,222 @@
+# x86-64 (System V) counterpart of asm.s used by the Linux host build.
+
+/**
+  * Initialize the stack of a process in such a way that it can be read
+  * from the transfer function.
+  * The saved stack pointer is stored in the last 8-byte slot of the stack,
+  * and a pointer to that slot is returned (same contract as asm.s).
+  * The frame below it is a cooperative _ctransfer frame that returns to
+  * _startProcess with rbx = entry point and r12 = exit routine; the
+  * interrupt switch status is initialized to 0, _startProcess allows
+  * interrupts.
+  */
+.global _createStack
+.text
+_createStack: # rdi = newSP
+			  # rsi = newPC
+			  # edx = stackSize - 4
+			  # rcx = exitPC
+	movslq %edx, %rdx
+	# pointer to the bottom of the stack, 16 byte aligned
+	leaq  (%rdi,%rdx), %rax
+	andq  $-16, %rax
+	# rax - 8 : slot holding the saved sp
+	# rax - 24: return address of _ctransfer = _startProcess, so that
+	#           _startProcess runs with a 16 byte aligned sp
+	leaq  _startProcess(%rip), %rdx
+	movq  %rdx, -24(%rax)
+	leaq  -80(%rax), %r8        # sp = 6 registers + status below
+	movq  $0, 0(%r8)            # status = 0
+	movq  $0, 8(%r8)            # r15
+	movq  $0, 16(%r8)           # r14
+	movq  $0, 24(%r8)           # r13
+	movq  %rcx, 32(%r8)         # r12 = exit routine
+	movq  $0, 40(%r8)           # rbp
+	movq  %rsi, 48(%r8)         # rbx = PC
+	# store sp on the stack bottom, tagged as a cooperative frame
+	leaq  1(%r8), %r8
+	movq  %r8, -8(%rax)
+	# return pointer to stack address
+	leaq  -8(%rax), %rax
+	ret
+
+/**
+ * First code run by a process: allow interrupts through allowInterrupts,
+ * which ends the masked window of the switch (IRQ_LATENCY) and takes the
+ * interrupts raised meanwhile, then call its function, then the exit
+ * routine if the function returns.
+ */
+_startProcess:
+	call  allowInterrupts
+	call  *%rbx
+	call  *%r12
+	ud2
+
+/**
+ * Context switch called from either a normal context or from an interrupt
+ * routine (a signal handler on the host). Like the Nios II version, every
+ * register and the interrupt switch status are saved, so the frame is the
+ * same whichever path suspended the process.
+ * The interrupt switch status is the host_interrupts_enabled flag
+ * maintained by hal_host.c. It, running and nextP are thread local, one
+ * per core in the SMP build (CORE_LOCAL in include/system.h).
+ * As in asm.s, bit 0 of the saved sp tells a full frame (clear) from a
+ * cooperative _ctransfer frame (set).
+ */
+.global _transfer
+.text
+_transfer:
+	pushq %rax
+	pushq %rbx
+	pushq %rcx
+	pushq %rdx
+	pushq %rsi
+	pushq %rdi
+	pushq %rbp
+	pushq %r8
+	pushq %r9
+	pushq %r10
+	pushq %r11
+	pushq %r12
+	pushq %r13
+	pushq %r14
+	pushq %r15
+	pushfq
+	# save the current interrupt switch status
+	movl  %fs:host_interrupts_enabled@tpoff, %eax
+	pushq %rax
+	# running->sp = sp
+	movq  %fs:running@tpoff, %rax
+	movq  %rsp, (%rax)
+
+_restore:
+	# running = nextP
+	movq  %fs:nextP@tpoff, %rax
+	movq  %rax, %fs:running@tpoff
+	# set sp to the sp from the nextP
+	movq  (%rax), %rsp
+	testq $1, %rsp
+	jnz   _restoreCooperative
+	# restore the interrupt switch status
+	popq  %rax
+	movl  %eax, %fs:host_interrupts_enabled@tpoff
+	popfq
+	popq  %r15
+	popq  %r14
+	popq  %r13
+	popq  %r12
+	popq  %r11
+	popq  %r10
+	popq  %r9
+	popq  %r8
+	popq  %rbp
+	popq  %rdi
+	popq  %rsi
+	popq  %rdx
+	popq  %rcx
+	popq  %rbx
+	popq  %rax
+	ret
+
+_restoreCooperative:
+	decq  %rsp
+	popq  %rax
+	movl  %eax, %fs:host_interrupts_enabled@tpoff
+	popq  %r15
+	popq  %r14
+	popq  %r13
+	popq  %r12
+	popq  %rbp
+	popq  %rbx
+	ret
+
+/**
+ * Cooperative context switch, for a process that blocks in a kernel call:
+ * only the callee saved registers and the interrupt switch status are
+ * kept (8 words with the return address, against 18 for _transfer).
+ */
+.global _ctransfer
+.text
+_ctransfer:
+	pushq %rbx
+	pushq %rbp
+	pushq %r12
+	pushq %r13
+	pushq %r14
+	pushq %r15
+	movl  %fs:host_interrupts_enabled@tpoff, %eax
+	pushq %rax
+	# running->sp = sp, tagged as a cooperative frame
+	movq  %fs:running@tpoff, %rax
+	leaq  1(%rsp), %rcx
+	movq  %rcx, (%rax)
+	jmp   _restore
+
+/**
+ * Host equivalent of the Nios II exception entry. hal_host.c redirects an
+ * interrupted process here with its pc pushed just below the red zone.
+ * All integer registers, the flags and the x87/SSE/AVX state are
+ * saved on the process stack, the pending ISRs run, and the process resumes
+ * where it was interrupted, popping the red zone skip with ret $128.
+ * An ISR may transfer() away; the process then resumes here later.
+ */
+.global host_irq_entry
+.text
+host_irq_entry:
+	pushfq
+	cld
+	pushq %rax
+	pushq %rbx
+	pushq %rcx
+	pushq %rdx
+	pushq %rsi
+	pushq %rdi
+	pushq %rbp
+	pushq %r8
+	pushq %r9
+	pushq %r10
+	pushq %r11
+	pushq %r12
+	pushq %r13
+	pushq %r14
+	pushq %r15
+	movq  %rsp, %rbx
+	# 64 byte aligned xsave area, header cleared as xrstor requires
+	subq  host_xsave_size(%rip), %rsp
+	andq  $-64, %rsp
+	xorl  %eax, %eax
+	movq  %rax, 512(%rsp)
+	movq  %rax, 520(%rsp)
+	movq  %rax, 528(%rsp)
+	movq  %rax, 536(%rsp)
+	movq  %rax, 544(%rsp)
+	movq  %rax, 552(%rsp)
+	movq  %rax, 560(%rsp)
+	movq  %rax, 568(%rsp)
+	movl  host_xsave_mask(%rip), %eax
+	movl  host_xsave_mask+4(%rip), %edx
+	xsave64 (%rsp)
+	call  host_dispatch_pending
+	movl  host_xsave_mask(%rip), %eax
+	movl  host_xsave_mask+4(%rip), %edx
+	xrstor64 (%rsp)
+	movq  %rbx, %rsp
+	popq  %r15
+	popq  %r14
+	popq  %r13
+	popq  %r12
+	popq  %r11
+	popq  %r10
+	popq  %r9
+	popq  %r8
+	popq  %rbp
+	popq  %rdi
+	popq  %rsi
+	popq  %rdx
+	popq  %rcx
+	popq  %rbx
+	popq  %rax
+	popfq
+	ret   $128
+
+.section .note.GNU-stack,"",@progbits
@@ -0,0 +1,145 @@
+/*
+ * Several producers and consumers sharing a one-slot buffer: a single
+ * wait queue per monitor, where every put and get has to notifyAll,
+ * against one condition per predicate (notFull, notEmpty) signalled
+ * with signalCondition.
+ *
+ * A spurious wakeup is a return from wait that finds its predicate still
+ * false and waits again. Built with -DMONITOR_HANDOFF as
+ * bench_conditions_handoff.
+ *
+ * usage: bench_conditions [producers consumers messages]
+ * (messages a multiple of both producers and consumers)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "kernel2.h"
+
+#define STACK_SIZE	16384
+
+static int producers, consumers, messages;
+static int mode;
+
+typedef struct {
+	int message;
+	int full;
+	int monitor;
+	int notFull;
+	int notEmpty;
+} Buffer;
+
+static Buffer buffer;
+static long wakeups, spurious;
+
+static void waitFor(int condition) {
+	if (mode == 0) {
+		wait();
+	} else {
+		waitOn(condition);
+	}
+	wakeups++;
+}
+
+static void put(Buffer* b, int m) {
+	enterMonitor(b->monitor);
+	while (b->full) {
+		waitFor(b->notFull);
+		spurious += b->full;
+	}
+	b->message = m;
+	b->full = 1;
+	if (mode == 0) {
+		notifyAll();
+	} else {
+		signalCondition(b->notEmpty);
+	}
+	exitMonitor();
+}
+
+static int get(Buffer* b) {
+	int m;
+	enterMonitor(b->monitor);
+	while (!b->full) {
+		waitFor(b->notEmpty);
+		spurious += !b->full;
+	}
+	m = b->message;
+	b->full = 0;
+	if (mode == 0) {
+		notifyAll();
+	} else {
+		signalCondition(b->notFull);
+	}
+	exitMonitor();
+	return m;
+}
+
+static void producer() {
+	int i;
+	for (i = 0; i < messages / producers; ++i) {
+		put(&buffer, i);
+	}
+}
+
+static void consumer() {
+	int i;
+	for (i = 0; i < messages / consumers; ++i) {
+		get(&buffer);
+	}
+}
+
+static double nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void driver() {
+	static const char* names[] = {"wait/notifyAll", "waitOn/signalCondition"};
+	int pids[64];
+	int i, n;
+
+	for (mode = 0; mode < 2; ++mode) {
+		wakeups = spurious = 0;
+		unsigned int s0 = getSwitchCount();
+		double t0 = nowNs();
+		unsigned long long c0 = __rdtsc();
+		n = 0;
+		for (i = 0; i < consumers; ++i) {
+			pids[n++] = createProcess(consumer, STACK_SIZE);
+		}
+		for (i = 0; i < producers; ++i) {
+			pids[n++] = createProcess(producer, STACK_SIZE);
+		}
+		for (i = 0; i < n; ++i) {
+			joinProcess(pids[i]);
+		}
+		double ns = nowNs() - t0;
+		unsigned long long cycles = __rdtsc() - c0;
+		printf("%-24s %7.1f ns %7.1f cycles %5.2f switches %5.2f wakeups %5.2f spurious /message\n",
+				names[mode], ns / messages, (double)cycles / messages,
+				(double)(getSwitchCount() - s0) / messages,
+				(double)wakeups / messages, (double)spurious / messages);
+	}
+	exit(0);
+}
+
+int main(int argc, char** argv) {
+	producers = argc > 1 ? atoi(argv[1]) : 4;
+	consumers = argc > 2 ? atoi(argv[2]) : 4;
+	messages = argc > 3 ? atoi(argv[3]) : 100000;
+	if (producers + consumers > 64 || messages % producers || messages % consumers) {
+		printf("at most 64 processes, messages a multiple of both counts\n");
+		return 1;
+	}
+	buffer.monitor = createMonitor();
+	buffer.notFull = createCondition(buffer.monitor);
+	buffer.notEmpty = createCondition(buffer.monitor);
+	buffer.full = 0;
+	createProcess(driver, STACK_SIZE);
+	start();
+	return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * Clock interrupts taken while the system is mostly idle.
+ *
+ * One process sleeps for SLEEP_MS in a loop and measures how late each
+ * sleep ends; the others block on a monitor forever. With the periodic
+ * tick the clock interrupts every CLOCK_PERIOD whatever the processes do;
+ * built with -DTICKLESS it should only interrupt once per sleep.
+ *
+ * usage: bench_idle [seconds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "system.h"
+#include "kernel2.h"
+
+#define STACK_SIZE	16384
+#define SLEEP_MS	50
+#define BLOCKED		4
+
+extern unsigned long host_irq_count[];
+
+static int seconds;
+static int monitor;
+
+static double nowMs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void blocked() {
+	enterMonitor(monitor);
+	while (1) {
+		wait();
+	}
+}
+
+static void sleeper() {
+	int rounds = seconds * 1000 / SLEEP_MS;
+	int i;
+	double late, maxLate = 0, sumLate = 0;
+	unsigned long irqs = host_irq_count[TIMER_IRQ];
+
+	for (i = 0; i < rounds; ++i) {
+		double t0 = nowMs();
+		sleep(SLEEP_MS);
+		late = nowMs() - t0 - SLEEP_MS;
+		sumLate += late;
+		if (late > maxLate) {
+			maxLate = late;
+		}
+	}
+
+	irqs = host_irq_count[TIMER_IRQ] - irqs;
+	printf("%-10s %10.1f %12.3f %12.3f\n",
+#ifdef TICKLESS
+			"tickless",
+#else
+			"tick",
+#endif
+			irqs * 1000.0 / (rounds * SLEEP_MS), sumLate / rounds, maxLate);
+	exit(0);
+}
+
+int main(int argc, char** argv) {
+	int i;
+
+	seconds = argc > 1 ? atoi(argv[1]) : 2;
+	monitor = createMonitor();
+	for (i = 0; i < BLOCKED; ++i) {
+		createProcess(blocked, STACK_SIZE);
+	}
+	createProcess(sleeper, STACK_SIZE);
+	start();
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Producer/consumer throughput: the one-slot monitor Buffer of
+ * kernelTest2.c against a mailbox, with one message per kernel call and
+ * with sendN/receiveN batches.
+ *
+ * usage: bench_mailbox [messages]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "kernel2.h"
+
+#define STACK_SIZE	16384
+#define CAPACITY	64
+#define BATCH		32
+
+static int messages;
+static int mode;
+static int mailbox;
+
+/* kernelTest2.c's Buffer, without the traces */
+typedef struct {
+	int message;
+	int full;
+	int monitor;
+} Buffer;
+
+static Buffer buffer;
+
+static void put(Buffer* b, int m) {
+	enterMonitor(b->monitor);
+	while(b->full) {
+		wait();
+	}
+	b->message = m;
+	b->full = 1;
+	notify();
+	exitMonitor();
+}
+
+static int get(Buffer* b) {
+	int m;
+	enterMonitor(b->monitor);
+	while (!b->full) {
+		wait();
+	}
+	m = b->message;
+	b->full = 0;
+	notifyAll();
+	exitMonitor();
+	return m;
+}
+
+static void producer() {
+	int i, j, batch[BATCH];
+	for (i = 0; i < messages; ) {
+		switch (mode) {
+		case 0:
+			put(&buffer, i++);
+			break;
+		case 1:
+			send(mailbox, i++);
+			break;
+		case 2:
+			for (j = 0; j < BATCH && i < messages; ++j) {
+				batch[j] = i++;
+			}
+			sendN(mailbox, batch, j);
+			break;
+		}
+	}
+}
+
+static void consumer() {
+	int i, j, n, m, batch[BATCH];
+	for (i = 0; i < messages; ) {
+		switch (mode) {
+		case 0:
+			m = get(&buffer);
+			if (m != i++) {
+				printf("got %d instead of %d\n", m, i - 1);
+				exit(1);
+			}
+			break;
+		case 1:
+			m = receive(mailbox);
+			if (m != i++) {
+				printf("got %d instead of %d\n", m, i - 1);
+				exit(1);
+			}
+			break;
+		case 2:
+			n = receiveN(mailbox, batch, BATCH);
+			for (j = 0; j < n; ++j) {
+				if (batch[j] != i++) {
+					printf("got %d instead of %d\n", batch[j], i - 1);
+					exit(1);
+				}
+			}
+			break;
+		}
+	}
+}
+
+static double nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void driver() {
+	static const char* names[] = {"monitor Buffer", "send/receive", "sendN/receiveN"};
+	for (mode = 0; mode < 3; ++mode) {
+		double t0 = nowNs();
+		unsigned long long c0 = __rdtsc();
+		int c = createProcess(consumer, STACK_SIZE);
+		int p = createProcess(producer, STACK_SIZE);
+		joinProcess(p);
+		joinProcess(c);
+		double ns = nowNs() - t0;
+		printf("%-16s %8.1f ns/message %8.1f cycles/message\n", names[mode],
+				ns / messages, (double)(__rdtsc() - c0) / messages);
+	}
+	exit(0);
+}
+
+int main(int argc, char** argv) {
+	messages = argc > 1 ? atoi(argv[1]) : 200000;
+	buffer.monitor = createMonitor();
+	buffer.full = 0;
+	mailbox = createMailbox(CAPACITY);
+	createProcess(driver, STACK_SIZE);
+	start();
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Time spent with interrupts masked by the monitor primitives, as a
+ * function of the number of processes waiting on the monitor.
+ *
+ * N workers wait on one monitor. The driver then enters the monitor and
+ * times notify, notifyAll and exitMonitor; each of them runs entirely
+ * between saveInterrupts and restoreInterrupts and never switches, so
+ * its duration is the interrupt-disabled window. With the O(1) queues the
+ * numbers should not depend on N.
+ *
+ * usage: bench_queues N   (N < MAX_PROC - 3)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+
+#include "kernel2.h"
+
+#define STACK_SIZE	16384
+#define ROUNDS		201
+
+static int workers;
+static int monitor;
+static volatile int waiting = 0;
+
+static unsigned long long notifyCycles[ROUNDS];
+static unsigned long long notifyAllCycles[ROUNDS];
+static unsigned long long exitCycles[ROUNDS];
+
+static void worker() {
+	enterMonitor(monitor);
+	while (1) {
+		waiting++;
+		wait();
+	}
+}
+
+static int compare(const void* a, const void* b) {
+	unsigned long long x = *(const unsigned long long*)a;
+	unsigned long long y = *(const unsigned long long*)b;
+	return x < y ? -1 : x > y;
+}
+
+static unsigned long long median(unsigned long long* samples) {
+	qsort(samples, ROUNDS, sizeof(samples[0]), compare);
+	return samples[ROUNDS / 2];
+}
+
+static void driver() {
+	int round;
+	unsigned long long t0;
+
+	for (round = 0; round < ROUNDS; ++round) {
+		while (waiting < workers) {
+			yield();
+		}
+		enterMonitor(monitor);
+		waiting = 0;
+
+		t0 = __rdtsc();
+		notify();
+		notifyCycles[round] = __rdtsc() - t0;
+
+		t0 = __rdtsc();
+		notifyAll();
+		notifyAllCycles[round] = __rdtsc() - t0;
+
+		t0 = __rdtsc();
+		exitMonitor();
+		exitCycles[round] = __rdtsc() - t0;
+	}
+
+	printf("%6d %12llu %12llu %12llu\n", workers, median(notifyCycles),
+			median(notifyAllCycles), median(exitCycles));
+	exit(0);
+}
+
+int main(int argc, char** argv) {
+	int i;
+
+	workers = argc > 1 ? atoi(argv[1]) : 8;
+	monitor = createMonitor();
+	for (i = 0; i < workers; ++i) {
+		createProcess(worker, STACK_SIZE);
+	}
+	createProcess(driver, STACK_SIZE);
+	start();
+	return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Readers and writers sharing a table, read mostly: a plain monitor
+ * against a reader-writer monitor, writer-preferring and FIFO.
+ *
+ * Each process yields once inside its critical section, as if it were
+ * preempted there. With a plain monitor, the others then block on the
+ * monitor; in shared mode, the readers keep going in. "inside" is the
+ * mean number of processes in the critical section when one goes in,
+ * and "writer wait" the most operations completed while a writer was
+ * waiting to go in.
+ *
+ * usage: bench_rw [readers writers operations]
+ * (operations a multiple of both counts, a tenth of them writes)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "kernel2.h"
+
+#define STACK_SIZE	16384
+#define TABLE_SIZE	16
+
+static int readers, writers, reads, writes;
+static int mode;
+static int monitor, rwMonitor[2];
+
+static int table[TABLE_SIZE];
+static long operations, insideSum, maxWriterWait;
+static int inside;
+static volatile int checksum;
+
+static void enterRead() {
+	if (mode == 0) {
+		enterMonitor(monitor);
+	} else {
+		enterShared(rwMonitor[mode - 1]);
+	}
+}
+
+static void enterWrite() {
+	if (mode == 0) {
+		enterMonitor(monitor);
+	} else {
+		enterExclusive(rwMonitor[mode - 1]);
+	}
+}
+
+static void leave() {
+	if (mode == 0) {
+		exitMonitor();
+	} else {
+		exitRW(rwMonitor[mode - 1]);
+	}
+}
+
+static void reader() {
+	int i, j;
+	for (i = 0; i < reads / readers; ++i) {
+		enterRead();
+		insideSum += ++inside;
+		int sum = 0;
+		for (j = 0; j < TABLE_SIZE; ++j) {
+			sum += table[j];
+		}
+		yield();
+		checksum = sum;
+		inside--;
+		operations++;
+		leave();
+	}
+}
+
+static void writer() {
+	int i, j;
+	for (i = 0; i < writes / writers; ++i) {
+		long before = operations;
+		enterWrite();
+		if (operations - before > maxWriterWait) {
+			maxWriterWait = operations - before;
+		}
+		insideSum += ++inside;
+		for (j = 0; j < TABLE_SIZE; ++j) {
+			table[j]++;
+		}
+		yield();
+		inside--;
+		operations++;
+		leave();
+	}
+}
+
+static double nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void driver() {
+	static const char* names[] = {"monitor", "rw writer-preferring", "rw fifo"};
+	int pids[64];
+	int i, n;
+	int total = reads + writes;
+
+	for (mode = 0; mode < 3; ++mode) {
+		operations = insideSum = maxWriterWait = 0;
+		unsigned int s0 = getSwitchCount();
+		double t0 = nowNs();
+		unsigned long long c0 = __rdtsc();
+		n = 0;
+		for (i = 0; i < writers; ++i) {
+			pids[n++] = createProcess(writer, STACK_SIZE);
+		}
+		for (i = 0; i < readers; ++i) {
+			pids[n++] = createProcess(reader, STACK_SIZE);
+		}
+		for (i = 0; i < n; ++i) {
+			joinProcess(pids[i]);
+		}
+		double ns = nowNs() - t0;
+		unsigned long long cycles = __rdtsc() - c0;
+		printf("%-22s %7.1f ns %7.1f cycles %5.2f switches /op %5.2f inside %6ld writer wait\n",
+				names[mode], ns / total, (double)cycles / total,
+				(double)(getSwitchCount() - s0) / total,
+				(double)insideSum / total, maxWriterWait);
+	}
+	exit(0);
+}
+
+int main(int argc, char** argv) {
+	readers = argc > 1 ? atoi(argv[1]) : 8;
+	writers = argc > 2 ? atoi(argv[2]) : 2;
+	int total = argc > 3 ? atoi(argv[3]) : 100000;
+	writes = total / 10;
+	reads = total - writes;
+	if (readers < 1 || writers < 1 || readers + writers > 64
+			|| reads % readers || writes % writers) {
+		printf("at most 64 processes, operations a multiple of both counts\n");
+		return 1;
+	}
+	monitor = createMonitor();
+	rwMonitor[0] = createRWMonitor(RW_WRITER_PREFERRING);
+	rwMonitor[1] = createRWMonitor(RW_FIFO);
+	createProcess(driver, STACK_SIZE);
+	start();
+	return 0;
+}
@@ -0,0 +1,258 @@
+/*
+ * The kernel built with SMP, one thread per core: checks that processes
+ * on several cores keep the kernel objects consistent, and measures what
+ * the cores buy on CPU bound work.
+ *
+ * - monitor: processes add to counters inside a monitor, yielding inside
+ *   now and then; no increment may be lost
+ * - semaphores: pairs of processes pass a token back and forth
+ * - mailbox: producers send numbers that consumers add up
+ * - churn: short processes are created and joined in batches, so that
+ *   descriptors and stacks of exited processes are reused
+ * - compute: the same work by one process, then split among as many
+ *   processes as cores; the speedup depends on the host CPUs
+ *
+ * Each line tells how the work spread over the cores. Exits with 1 if a
+ * check fails.
+ *
+ * usage: bench_smp [processes rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "kernel2.h"
+#include "system_m.h"
+
+#define STACK_SIZE	16384
+#define MAX_WORKERS	64
+
+static int workers, rounds;
+static int failures = 0;
+
+static int monitor;
+static long counter;
+static int perCore[NUM_CORES];
+
+static int pingSem[MAX_WORKERS], pongSem[MAX_WORKERS];
+static int nextPinger, nextPonger;
+static long passes;
+
+static int mailbox;
+static long received;
+
+static volatile unsigned long computeSink;
+static long computeWork;
+
+static double nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* processes count on which core they were in perCore, under monitor */
+static void countCore() {
+	perCore[core_id()]++;
+}
+
+static void clearCores() {
+	int core;
+	for (core = 0; core < NUM_CORES; ++core) {
+		perCore[core] = 0;
+	}
+}
+
+static void printCores() {
+	int core;
+	printf(" cores");
+	for (core = 0; core < NUM_CORES; ++core) {
+		printf(" %d", perCore[core]);
+	}
+}
+
+static void check(const char* name, long got, long expected, double ns) {
+	printf("%-10s %10ld %9.1f ms", name, got, ns / 1e6);
+	printCores();
+	if (got != expected) {
+		printf("  FAILED, expected %ld", expected);
+		failures++;
+	}
+	printf("\n");
+}
+
+static void adder() {
+	int i;
+	for (i = 0; i < rounds; ++i) {
+		enterMonitor(monitor);
+		long value = counter;
+		if (i % 16 == 0) {
+			yield();
+		}
+		counter = value + 1;
+		countCore();
+		exitMonitor();
+	}
+}
+
+static void pinger() {
+	enterMonitor(monitor);
+	int pair = nextPinger++;
+	exitMonitor();
+	int i;
+	for (i = 0; i < rounds; ++i) {
+		semaphorePost(pingSem[pair]);
+		semaphoreWait(pongSem[pair]);
+	}
+}
+
+static void ponger() {
+	enterMonitor(monitor);
+	int pair = nextPonger++;
+	exitMonitor();
+	int i;
+	for (i = 0; i < rounds; ++i) {
+		semaphoreWait(pingSem[pair]);
+		enterMonitor(monitor);
+		passes++;
+		countCore();
+		exitMonitor();
+		semaphorePost(pongSem[pair]);
+	}
+}
+
+static void producer() {
+	int i;
+	for (i = 1; i <= rounds; ++i) {
+		send(mailbox, i);
+	}
+}
+
+static void consumer() {
+	int i;
+	long sum = 0;
+	for (i = 0; i < rounds; ++i) {
+		sum += receive(mailbox);
+	}
+	enterMonitor(monitor);
+	received += sum;
+	countCore();
+	exitMonitor();
+}
+
+static void shortLived() {
+	enterMonitor(monitor);
+	counter++;
+	countCore();
+	exitMonitor();
+}
+
+static void computer() {
+	unsigned long x = 1;
+	long i;
+	for (i = 0; i < computeWork; ++i) {
+		x = x * 6364136223846793005ul + 1442695040888963407ul;
+	}
+	computeSink += x;
+	enterMonitor(monitor);
+	countCore();
+	exitMonitor();
+}
+
+static void runAll(void (*f)(), int n) {
+	int pids[MAX_WORKERS];
+	int i;
+	for (i = 0; i < n; ++i) {
+		pids[i] = createProcess(f, STACK_SIZE);
+	}
+	for (i = 0; i < n; ++i) {
+		joinProcess(pids[i]);
+	}
+}
+
+static double computeRun(int n, long work) {
+	computeWork = work / n;
+	clearCores();
+	double t0 = nowNs();
+	runAll(computer, n);
+	return nowNs() - t0;
+}
+
+static void driver() {
+	KernelStats stats;
+	double t0;
+	int i;
+
+	printf("%d cores, %d processes, %d rounds\n", NUM_CORES, workers, rounds);
+
+	counter = 0;
+	clearCores();
+	t0 = nowNs();
+	runAll(adder, workers);
+	check("monitor", counter, (long)workers * rounds, nowNs() - t0);
+
+	nextPinger = nextPonger = 0;
+	passes = 0;
+	clearCores();
+	t0 = nowNs();
+	int pids[MAX_WORKERS];
+	for (i = 0; i < workers / 2; ++i) {
+		pids[2 * i] = createProcess(pinger, STACK_SIZE);
+		pids[2 * i + 1] = createProcess(ponger, STACK_SIZE);
+	}
+	for (i = 0; i < workers / 2 * 2; ++i) {
+		joinProcess(pids[i]);
+	}
+	check("semaphores", passes, (long)(workers / 2) * rounds, nowNs() - t0);
+
+	received = 0;
+	clearCores();
+	t0 = nowNs();
+	for (i = 0; i < workers / 2; ++i) {
+		pids[2 * i] = createProcess(producer, STACK_SIZE);
+		pids[2 * i + 1] = createProcess(consumer, STACK_SIZE);
+	}
+	for (i = 0; i < workers / 2 * 2; ++i) {
+		joinProcess(pids[i]);
+	}
+	check("mailbox", received, (long)(workers / 2) * rounds * (rounds + 1) / 2, nowNs() - t0);
+
+	counter = 0;
+	clearCores();
+	t0 = nowNs();
+	for (i = 0; i < rounds / 10; ++i) {
+		runAll(shortLived, workers);
+	}
+	check("churn", counter, (long)(rounds / 10) * workers, nowNs() - t0);
+
+	long work = 200000000;
+	double one = computeRun(1, work);
+	double all = computeRun(NUM_CORES, work);
+	printf("compute    %.1f ms alone, %.1f ms on %d processes, speedup %.2f",
+			one / 1e6, all / 1e6, NUM_CORES, one / all);
+	printCores();
+	printf("\n");
+
+	getKernelStats(&stats);
+	printf("%u switches, %u steals, %u interrupts between cores\n",
+			stats.switches, stats.steals, stats.kicks);
+	printf("%s\n", failures == 0 ? "ok" : "FAILED");
+	exit(failures != 0);
+}
+
+int main(int argc, char** argv) {
+	workers = argc > 1 ? atoi(argv[1]) : 8;
+	rounds = argc > 2 ? atoi(argv[2]) : 2000;
+	if (workers < 2 || workers > MAX_WORKERS || rounds < 10) {
+		printf("2 to %d processes, at least 10 rounds\n", MAX_WORKERS);
+		return 1;
+	}
+	monitor = createMonitor();
+	for (int i = 0; i < workers / 2; ++i) {
+		pingSem[i] = createSemaphore(0);
+		pongSem[i] = createSemaphore(0);
+	}
+	mailbox = createMailbox(16);
+	createProcess(driver, STACK_SIZE);
+	start();
+	return 0;
+}
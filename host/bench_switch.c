@@ -0,0 +1,119 @@
+/*
+ * Context switch latency on the host build.
+ *
+ * Two processes ping-pong with transfer() (full 17 word frame of
+ * asm_x86_64.s, same shape as the 25 word Nios II frame), then with the
+ * cooperative ctransfer() used by blocking kernel calls (7 words, 11 on
+ * Nios II), then with the native glibc swapcontext() switch.
+ * Interrupts are never started, so nothing but the switch is measured.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ucontext.h>
+#include <x86intrin.h>
+
+#include "system_m.h"
+
+#define STACK_SIZE	16384
+#define ROUNDS		1000000
+
+static unsigned int mainSlot[2];
+static Process mainProcess;
+static Process ping, pong;
+static volatile int remaining;
+
+static ucontext_t mainContext, pingContext, pongContext;
+
+static void pingCode() {
+	while (--remaining > 0) {
+		transfer(pong);
+	}
+	transfer(mainProcess);
+}
+
+static void pongCode() {
+	while (1) {
+		transfer(ping);
+	}
+}
+
+static void pingCooperative() {
+	while (--remaining > 0) {
+		ctransfer(pong);
+	}
+	ctransfer(mainProcess);
+}
+
+static void pongCooperative() {
+	while (1) {
+		ctransfer(ping);
+	}
+}
+
+static void pingNative() {
+	while (--remaining > 0) {
+		swapcontext(&pingContext, &pongContext);
+	}
+	swapcontext(&pingContext, &mainContext);
+}
+
+static void pongNative() {
+	while (1) {
+		swapcontext(&pongContext, &pingContext);
+	}
+}
+
+static double nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char* name, double ns, unsigned long long cycles) {
+	/* each round is two switches */
+	printf("%-28s %8.1f ns/switch %8.1f cycles/switch\n", name,
+			ns / (2.0 * ROUNDS), (double)cycles / (2.0 * ROUNDS));
+}
+
+int main() {
+	double t0;
+	unsigned long long c0;
+
+	running = (Process)mainSlot;
+	mainProcess = running;
+	ping = newProcess(pingCode, malloc(STACK_SIZE), STACK_SIZE);
+	pong = newProcess(pongCode, malloc(STACK_SIZE), STACK_SIZE);
+
+	remaining = ROUNDS;
+	t0 = nowNs();
+	c0 = __rdtsc();
+	transfer(ping);
+	report("full-frame transfer()", nowNs() - t0, __rdtsc() - c0);
+
+	ping = newProcess(pingCooperative, malloc(STACK_SIZE), STACK_SIZE);
+	pong = newProcess(pongCooperative, malloc(STACK_SIZE), STACK_SIZE);
+
+	remaining = ROUNDS;
+	t0 = nowNs();
+	c0 = __rdtsc();
+	ctransfer(ping);
+	report("cooperative ctransfer()", nowNs() - t0, __rdtsc() - c0);
+
+	getcontext(&pingContext);
+	pingContext.uc_stack.ss_sp = malloc(STACK_SIZE);
+	pingContext.uc_stack.ss_size = STACK_SIZE;
+	makecontext(&pingContext, pingNative, 0);
+	getcontext(&pongContext);
+	pongContext.uc_stack.ss_sp = malloc(STACK_SIZE);
+	pongContext.uc_stack.ss_size = STACK_SIZE;
+	makecontext(&pongContext, pongNative, 0);
+
+	remaining = ROUNDS;
+	t0 = nowNs();
+	c0 = __rdtsc();
+	swapcontext(&mainContext, &pingContext);
+	report("native swapcontext()", nowNs() - t0, __rdtsc() - c0);
+
+	return 0;
+}
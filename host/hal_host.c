@@ -0,0 +1,550 @@
+/*
+ * Linux host stand-in for the parts of the Nios II HAL the kernel uses.
+ *
+ * - maskInterrupts/allowInterrupts and saveInterrupts/restoreInterrupts
+ *   act on a software interrupt switch (host_interrupts_enabled) which
+ *   _transfer saves and restores exactly like the status register on the
+ *   board.
+ * - alt_irq_register records the ISR; host signals play the role of
+ *   interrupt lines; the ISR runs on the stack of whatever process was
+ *   interrupted, so it may transfer() away just like on the board.
+ * - IORD/IOWR are routed to small models of the Avalon timer (driven by
+ *   SIGALRM) and of the button PIO (driven by SIGIO on stdin: typing the
+ *   digits 0-3 presses the corresponding button).
+ * - Built with SMP, each core is a thread with its own interrupt switch
+ *   and pending interrupts; the clock and the buttons interrupt core 0,
+ *   and SIGUSR1 is the interprocessor interrupt (see ../smp.h).
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <cpuid.h>
+#ifdef SMP
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "system.h"
+#include "sys/alt_irq.h"
+#include "altera_avalon_pio_regs.h"
+#include "altera_avalon_timer_regs.h"
+#include "interrupt.h"
+
+#define HOST_MAX_IRQ 32
+
+/* Interrupt switch status, saved and restored by _transfer. */
+CORE_LOCAL volatile int host_interrupts_enabled = 1;
+
+/* One bit per IRQ line that has been raised but not yet serviced. */
+static CORE_LOCAL volatile unsigned int host_irq_pending = 0;
+
+static struct {
+	alt_isr_func handler;
+	void* context;
+} host_isr[HOST_MAX_IRQ];
+
+/* Number of times each ISR has run, for the benchmarks. */
+unsigned long host_irq_count[HOST_MAX_IRQ];
+
+/*************** Interrupt switch and dispatch ***************/
+
+/* An ISR may switch to a process that resumes on another core: the
+ * variables of the core are looked up again after each ISR, never through
+ * an address the compiler kept in a register across the call. */
+static __attribute__((noinline, noipa)) volatile unsigned int* host_pending() {
+	return &host_irq_pending;
+}
+
+static __attribute__((noinline, noipa)) volatile int* host_enabled() {
+	return &host_interrupts_enabled;
+}
+
+/* Runs the pending ISRs with the switch cleared, then sets it again. Called
+ * from allowInterrupts and from host_irq_entry (asm_x86_64.s). */
+void host_dispatch_pending() {
+	do {
+		unsigned int pending;
+		while ((pending = *host_pending()) != 0) {
+			int irq = __builtin_ctz(pending);
+			__atomic_fetch_and(host_pending(), ~(1u << irq), __ATOMIC_SEQ_CST);
+			if (host_isr[irq].handler != NULL) {
+				host_irq_count[irq]++;
+				host_isr[irq].handler(host_isr[irq].context, irq);
+			}
+		}
+		*host_enabled() = 1;
+		/* an interrupt raised between the last check and re-enabling */
+	} while (*host_pending() != 0
+			&& __atomic_exchange_n(host_enabled(), 0, __ATOMIC_SEQ_CST));
+}
+
+void maskInterrupts() {
+#ifdef IRQ_LATENCY
+	if (__atomic_exchange_n(&host_interrupts_enabled, 0, __ATOMIC_SEQ_CST)) {
+		irq_masked_begin();
+	}
+#else
+	host_interrupts_enabled = 0;
+#endif
+}
+
+void allowInterrupts() {
+#ifdef IRQ_LATENCY
+	if (!host_interrupts_enabled) {
+		irq_masked_end();
+	}
+#endif
+	host_interrupts_enabled = 1;
+	if (host_irq_pending != 0
+			&& __atomic_exchange_n(&host_interrupts_enabled, 0, __ATOMIC_SEQ_CST)) {
+		host_dispatch_pending();
+	}
+}
+
+int saveInterrupts() {
+	int state = __atomic_exchange_n(&host_interrupts_enabled, 0, __ATOMIC_SEQ_CST);
+#ifdef IRQ_LATENCY
+	if (state) {
+		irq_masked_begin();
+	}
+#endif
+	return state;
+}
+
+void restoreInterrupts(int state) {
+	if (state) {
+		allowInterrupts();
+	}
+}
+
+/* The process sleeps until a signal arrives; the signal handler redirects
+ * it to the ISRs as usual. */
+void waitForInterrupt() {
+	pause();
+}
+
+int alt_irq_register(alt_u32 id, void* context, alt_isr_func handler) {
+	if (id >= HOST_MAX_IRQ) {
+		return -1;
+	}
+	host_isr[id].context = context;
+	host_isr[id].handler = handler;
+	return 0;
+}
+
+/*
+ * Host signals are the interrupt lines. The signal handler itself runs on
+ * an alternate stack and never runs an ISR: it updates the device model,
+ * marks the IRQ pending and, if interrupts are enabled, redirects the
+ * interrupted context to host_irq_entry. That way the ISR runs on the
+ * interrupted process's own stack with a small frame, exactly like the
+ * Nios II exception handler, and is free to transfer() elsewhere.
+ */
+extern void host_irq_entry();
+
+/* State components saved by host_irq_entry (x87, SSE, AVX and AVX-512; the
+ * AMX tile data would not fit on a process stack and is never used) and the
+ * size of the xsave area it reserves on the process stack. */
+#define HOST_XSAVE_COMPONENTS 0xe7
+unsigned long long host_xsave_mask = 0;
+unsigned long host_xsave_size = 0;
+
+#define HOST_SIGNAL_STACK_SIZE 65536
+
+static char host_signal_stack[HOST_SIGNAL_STACK_SIZE];
+
+/* Signal handlers run on an alternate stack of the thread */
+static void host_signal_stack_init(char* stack) {
+	stack_t ss;
+	ss.ss_sp = stack;
+	ss.ss_size = HOST_SIGNAL_STACK_SIZE;
+	ss.ss_flags = 0;
+	sigaltstack(&ss, NULL);
+}
+
+static void host_raise_irq(int irq, ucontext_t* uc) {
+	__atomic_fetch_or(&host_irq_pending, 1u << irq, __ATOMIC_SEQ_CST);
+	if (!host_interrupts_enabled) {
+		/* delivered by the next allowInterrupts */
+		return;
+	}
+	host_interrupts_enabled = 0;
+
+	/* push the interrupted pc below the red zone and resume in host_irq_entry */
+	greg_t* regs = uc->uc_mcontext.gregs;
+	unsigned long sp = regs[REG_RSP] - 128 - 8;
+	*(unsigned long*)sp = regs[REG_RIP];
+	regs[REG_RSP] = sp;
+	regs[REG_RIP] = (greg_t)host_irq_entry;
+}
+
+static void host_install(int sig, void (*handler)(int, siginfo_t*, void*)) {
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = handler;
+	sa.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaddset(&sa.sa_mask, SIGALRM);
+	sigaddset(&sa.sa_mask, SIGIO);
+	sigaddset(&sa.sa_mask, SIGUSR1);
+	sigaction(sig, &sa, NULL);
+}
+
+static void __attribute__((constructor)) host_hal_init() {
+	unsigned int eax, ebx, ecx, edx, xcr0_lo, xcr0_hi;
+	int i;
+	__asm__ volatile ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	host_xsave_mask = xcr0_lo & HOST_XSAVE_COMPONENTS;
+	host_xsave_size = 576; /* legacy region and header */
+	for (i = 2; i < 8; ++i) {
+		if (host_xsave_mask & (1u << i)) {
+			__cpuid_count(0xd, i, eax, ebx, ecx, edx);
+			if (eax + ebx > host_xsave_size) {
+				host_xsave_size = eax + ebx;
+			}
+		}
+	}
+
+	host_signal_stack_init(host_signal_stack);
+}
+
+/*************** Cores ***************/
+
+#ifdef SMP
+static CORE_LOCAL int host_core = 0;
+static pthread_t host_threads[NUM_CORES];
+static void (*host_core_entry)();
+static volatile int host_cores_go = 0;
+static void (*host_ipi_handler)();
+
+int core_id() {
+	return host_core;
+}
+
+/* With fewer host CPUs than cores, the thread waited for may itself be
+ * waiting for a CPU: give it ours now and then */
+void spin_wait() {
+	static CORE_LOCAL unsigned int spins;
+	if (++spins % 256 == 0) {
+		sched_yield();
+	} else {
+		__builtin_ia32_pause();
+	}
+}
+
+void spin_lock(SpinLock* lock) {
+	while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+		while (*lock) {
+			spin_wait();
+		}
+	}
+}
+
+void spin_unlock(SpinLock* lock) {
+	__atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+static void* host_core_main(void* core) {
+	sigset_t ipi;
+	host_core = (int)(long)core;
+	host_interrupts_enabled = 0;
+	host_signal_stack_init(malloc(HOST_SIGNAL_STACK_SIZE));
+	/* the thread started with the interrupt blocked: until here, it had
+	 * neither its core number nor its switch cleared */
+	sigemptyset(&ipi);
+	sigaddset(&ipi, SIGUSR1);
+	pthread_sigmask(SIG_UNBLOCK, &ipi, NULL);
+	/* every thread id is known before any core sends an interrupt */
+	while (!host_cores_go) {
+		spin_wait();
+	}
+	host_core_entry();
+	return NULL;
+}
+
+void start_cores(void (*entry)()) {
+	sigset_t devices, old;
+	int core;
+	host_core_entry = entry;
+	host_threads[0] = pthread_self();
+	/* the clock and the buttons interrupt core 0 only: the other threads
+	 * start with their signals blocked, and unblock their own interrupt */
+	sigemptyset(&devices);
+	sigaddset(&devices, SIGALRM);
+	sigaddset(&devices, SIGIO);
+	sigaddset(&devices, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &devices, &old);
+	for (core = 1; core < NUM_CORES; ++core) {
+		if (pthread_create(&host_threads[core], NULL, host_core_main, (void*)(long)core) != 0) {
+			fprintf(stderr, "Error: cannot start core %d\n", core);
+			exit(1);
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	__atomic_store_n(&host_cores_go, 1, __ATOMIC_SEQ_CST);
+}
+
+static void host_ipi_signal(int sig, siginfo_t* info, void* uc) {
+	host_raise_irq(SMP_IPI_IRQ, uc);
+}
+
+static void host_ipi_isr(void* context, alt_u32 id) {
+	irq_masked_begin();
+	host_ipi_handler();
+	irq_masked_end();
+}
+
+void init_ipi(void (*handler)()) {
+	host_ipi_handler = handler;
+	alt_irq_register(SMP_IPI_IRQ, NULL, host_ipi_isr);
+	host_install(SIGUSR1, host_ipi_signal);
+}
+
+void send_ipi(int core) {
+	pthread_kill(host_threads[core], SIGUSR1);
+}
+#endif
+
+/*************** Avalon timer model ***************/
+
+static unsigned int timer_status = 0;
+static unsigned int timer_control = 0;
+static unsigned int timer_period = TIMER_LOAD_VALUE;
+static unsigned int timer_snap = 0;
+static int timer_installed = 0;
+static struct timespec timer_started;
+
+static void host_timer_signal(int sig, siginfo_t* info, void* uc) {
+	timer_status |= ALTERA_AVALON_TIMER_STATUS_TO_MSK;
+	if (!(timer_control & ALTERA_AVALON_TIMER_CONTROL_CONT_MSK)) {
+		timer_status &= ~ALTERA_AVALON_TIMER_STATUS_RUN_MSK;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &timer_started);
+	if (timer_control & ALTERA_AVALON_TIMER_CONTROL_ITO_MSK) {
+		host_raise_irq(TIMER_IRQ, uc);
+	}
+}
+
+static void host_timer_arm(int run) {
+	struct itimerval it;
+	memset(&it, 0, sizeof(it));
+	if (run) {
+		unsigned long long ns = ((unsigned long long)timer_period + 1)
+				* 1000000000ull / TIMER_FREQ;
+		it.it_value.tv_sec = ns / 1000000000ull;
+		it.it_value.tv_usec = (ns % 1000000000ull) / 1000;
+		if (it.it_value.tv_sec == 0 && it.it_value.tv_usec == 0) {
+			it.it_value.tv_usec = 1;
+		}
+		if (timer_control & ALTERA_AVALON_TIMER_CONTROL_CONT_MSK) {
+			it.it_interval = it.it_value;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &timer_started);
+	}
+	if (!timer_installed) {
+		host_install(SIGALRM, host_timer_signal);
+		timer_installed = 1;
+	}
+	setitimer(ITIMER_REAL, &it, NULL);
+}
+
+/* Value of the down counter, as latched by a write to a snap register. */
+static unsigned int host_timer_counter() {
+	if (!(timer_status & ALTERA_AVALON_TIMER_STATUS_RUN_MSK)) {
+		return timer_period;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	unsigned long long elapsed_ns = (now.tv_sec - timer_started.tv_sec) * 1000000000ull
+			+ now.tv_nsec - timer_started.tv_nsec;
+	unsigned long long ticks = elapsed_ns * (TIMER_FREQ / 1000000) / 1000;
+	if (ticks > timer_period) {
+		return 0;
+	}
+	return timer_period - (unsigned int)ticks;
+}
+
+static unsigned int host_timer_read(int regnum) {
+	switch (regnum) {
+	case ALTERA_AVALON_TIMER_STATUS_REG:  return timer_status;
+	case ALTERA_AVALON_TIMER_CONTROL_REG: return timer_control;
+	case ALTERA_AVALON_TIMER_PERIODL_REG: return timer_period & 0xffff;
+	case ALTERA_AVALON_TIMER_PERIODH_REG: return timer_period >> 16;
+	case ALTERA_AVALON_TIMER_SNAPL_REG:   return timer_snap & 0xffff;
+	case ALTERA_AVALON_TIMER_SNAPH_REG:   return timer_snap >> 16;
+	}
+	return 0;
+}
+
+static void host_timer_write(int regnum, unsigned int data) {
+	switch (regnum) {
+	case ALTERA_AVALON_TIMER_STATUS_REG:
+		/* any write clears TO */
+		timer_status &= ~ALTERA_AVALON_TIMER_STATUS_TO_MSK;
+		break;
+	case ALTERA_AVALON_TIMER_CONTROL_REG:
+		timer_control = data & (ALTERA_AVALON_TIMER_CONTROL_ITO_MSK
+				| ALTERA_AVALON_TIMER_CONTROL_CONT_MSK);
+		if (data & ALTERA_AVALON_TIMER_CONTROL_STOP_MSK) {
+			timer_status &= ~ALTERA_AVALON_TIMER_STATUS_RUN_MSK;
+			host_timer_arm(0);
+		} else if (data & ALTERA_AVALON_TIMER_CONTROL_START_MSK) {
+			timer_status |= ALTERA_AVALON_TIMER_STATUS_RUN_MSK;
+			host_timer_arm(1);
+		}
+		break;
+	case ALTERA_AVALON_TIMER_PERIODL_REG:
+	case ALTERA_AVALON_TIMER_PERIODH_REG:
+		/* writing the period stops the counter, as on the real core */
+		if (regnum == ALTERA_AVALON_TIMER_PERIODL_REG) {
+			timer_period = (timer_period & 0xffff0000u) | (data & 0xffff);
+		} else {
+			timer_period = (timer_period & 0xffff) | ((data & 0xffff) << 16);
+		}
+		timer_status &= ~ALTERA_AVALON_TIMER_STATUS_RUN_MSK;
+		host_timer_arm(0);
+		break;
+	case ALTERA_AVALON_TIMER_SNAPL_REG:
+	case ALTERA_AVALON_TIMER_SNAPH_REG:
+		timer_snap = host_timer_counter();
+		break;
+	}
+}
+
+/*************** Button PIO model ***************/
+
+static unsigned int button_irq_mask = 0;
+static unsigned int button_edge_cap = 0;
+static int button_installed = 0;
+
+static void host_button_signal(int sig, siginfo_t* info, void* uc) {
+	int available = 0;
+	if (ioctl(STDIN_FILENO, FIONREAD, &available) == 0 && available > 0) {
+		char buf[64];
+		if (available > (int)sizeof(buf)) {
+			available = sizeof(buf);
+		}
+		int n = read(STDIN_FILENO, buf, available);
+		int i;
+		for (i = 0; i < n; ++i) {
+			if (buf[i] >= '0' && buf[i] <= '3') {
+				button_edge_cap |= 1u << (buf[i] - '0');
+			}
+		}
+	}
+	/* also sent by host_press_button on another core */
+	if (button_edge_cap & button_irq_mask) {
+		host_raise_irq(BUTTONS_IRQ, uc);
+	}
+}
+
+static void host_button_write(int regnum, unsigned int data) {
+	switch (regnum) {
+	case 2:
+		button_irq_mask = data;
+		if (!button_installed) {
+			host_install(SIGIO, host_button_signal);
+			fcntl(STDIN_FILENO, F_SETOWN, getpid());
+			fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_ASYNC);
+			button_installed = 1;
+		}
+		break;
+	case 3:
+		/* writing the edge capture register clears it */
+		button_edge_cap = 0;
+		break;
+	}
+}
+
+/* Presses a button from the program itself, for the benchmarks: the
+ * interrupt is taken at once if interrupts are enabled, as if the edge
+ * had arrived at this instruction, and otherwise when they are allowed. */
+void host_press_button(int button) {
+	button_edge_cap |= 1u << button;
+#ifdef SMP
+	if (core_id() != 0) {
+		/* the buttons interrupt core 0 */
+		pthread_kill(host_threads[0], SIGIO);
+		return;
+	}
+#endif
+	if (button_edge_cap & button_irq_mask) {
+		__atomic_fetch_or(&host_irq_pending, 1u << BUTTONS_IRQ, __ATOMIC_SEQ_CST);
+		if (__atomic_exchange_n(&host_interrupts_enabled, 0, __ATOMIC_SEQ_CST)) {
+			host_dispatch_pending();
+		}
+	}
+}
+
+static unsigned int host_button_read(int regnum) {
+	switch (regnum) {
+	case 2: return button_irq_mask;
+	case 3: return button_edge_cap;
+	}
+	return 0;
+}
+
+/*************** Display model ***************/
+
+static unsigned int led_value[3];
+static int led_shown = -1;
+
+static int host_led_digit(unsigned int code) {
+	static const unsigned int codes[] = {0x3E223E00, 0x203E2400, 0x2E2A3A00,
+			0x3E2A2A00, 0x3E080E00, 0x3A2A2E00, 0x3A2A3E00, 0x3E020200,
+			0x3E2A3E00, 0x3E2A2E00};
+	int i;
+	for (i = 0; i < 10; ++i) {
+		if (codes[i] == code) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+/* The display is refreshed zone 2 first and zone 0 last. */
+static void host_led_write(int zone, unsigned int data) {
+	led_value[zone] = data;
+	if (zone == 0) {
+		int shown = host_led_digit(led_value[0]) * 100
+				+ host_led_digit(led_value[1]) * 10 + host_led_digit(led_value[2]);
+		if (shown != led_shown) {
+			/* no stdio here: an unbuffered fprintf needs 8 KB of the caller's
+			 * stack, more than a 10000 byte process stack can spare */
+			char line[] = "[display] 000\n";
+			line[10] += shown / 100;
+			line[11] += (shown / 10) % 10;
+			line[12] += shown % 10;
+			led_shown = shown;
+			write(STDERR_FILENO, line, sizeof(line) - 1);
+		}
+	}
+}
+
+/*************** Register access ***************/
+
+unsigned int host_iord(unsigned int base, int regnum) {
+	switch (base) {
+	case TIMER_BASE:   return host_timer_read(regnum);
+	case BUTTONS_BASE: return host_button_read(regnum);
+	}
+	return 0;
+}
+
+void host_iowr(unsigned int base, int regnum, unsigned int data) {
+	switch (base) {
+	case TIMER_BASE:   host_timer_write(regnum, data); break;
+	case BUTTONS_BASE: host_button_write(regnum, data); break;
+	case LED_0_BASE:   host_led_write(0, data); break;
+	case LED_1_BASE:   host_led_write(1, data); break;
+	case LED_2_BASE:   host_led_write(2, data); break;
+	}
+}
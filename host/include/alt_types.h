@@ -0,0 +1,14 @@
+#ifndef ALT_TYPES_H_
+#define ALT_TYPES_H_
+
+/* Host stand-in for the Nios II HAL integer types. */
+typedef signed char    alt_8;
+typedef unsigned char  alt_u8;
+typedef signed short   alt_16;
+typedef unsigned short alt_u16;
+typedef signed int     alt_32;
+typedef unsigned int   alt_u32;
+typedef long long          alt_64;
+typedef unsigned long long alt_u64;
+
+#endif /*ALT_TYPES_H_*/
@@ -0,0 +1,19 @@
+#ifndef ALTERA_AVALON_PIO_REGS_H_
+#define ALTERA_AVALON_PIO_REGS_H_
+
+#include "io.h"
+
+#define IOADDR_ALTERA_AVALON_PIO_DATA(base)       (base)
+#define IORD_ALTERA_AVALON_PIO_DATA(base)         IORD(base, 0)
+#define IOWR_ALTERA_AVALON_PIO_DATA(base, data)   IOWR(base, 0, data)
+
+#define IORD_ALTERA_AVALON_PIO_DIRECTION(base)        IORD(base, 1)
+#define IOWR_ALTERA_AVALON_PIO_DIRECTION(base, data)  IOWR(base, 1, data)
+
+#define IORD_ALTERA_AVALON_PIO_IRQ_MASK(base)         IORD(base, 2)
+#define IOWR_ALTERA_AVALON_PIO_IRQ_MASK(base, data)   IOWR(base, 2, data)
+
+#define IORD_ALTERA_AVALON_PIO_EDGE_CAP(base)         IORD(base, 3)
+#define IOWR_ALTERA_AVALON_PIO_EDGE_CAP(base, data)   IOWR(base, 3, data)
+
+#endif /*ALTERA_AVALON_PIO_REGS_H_*/
@@ -0,0 +1,35 @@
+#ifndef ALTERA_AVALON_TIMER_REGS_H_
+#define ALTERA_AVALON_TIMER_REGS_H_
+
+#include "io.h"
+
+#define ALTERA_AVALON_TIMER_STATUS_REG   0
+#define ALTERA_AVALON_TIMER_CONTROL_REG  1
+#define ALTERA_AVALON_TIMER_PERIODL_REG  2
+#define ALTERA_AVALON_TIMER_PERIODH_REG  3
+#define ALTERA_AVALON_TIMER_SNAPL_REG    4
+#define ALTERA_AVALON_TIMER_SNAPH_REG    5
+
+#define IORD_ALTERA_AVALON_TIMER_STATUS(base)         IORD(base, 0)
+#define IOWR_ALTERA_AVALON_TIMER_STATUS(base, data)   IOWR(base, 0, data)
+#define ALTERA_AVALON_TIMER_STATUS_TO_MSK             (0x1)
+#define ALTERA_AVALON_TIMER_STATUS_RUN_MSK            (0x2)
+
+#define IORD_ALTERA_AVALON_TIMER_CONTROL(base)        IORD(base, 1)
+#define IOWR_ALTERA_AVALON_TIMER_CONTROL(base, data)  IOWR(base, 1, data)
+#define ALTERA_AVALON_TIMER_CONTROL_ITO_MSK           (0x1)
+#define ALTERA_AVALON_TIMER_CONTROL_CONT_MSK          (0x2)
+#define ALTERA_AVALON_TIMER_CONTROL_START_MSK         (0x4)
+#define ALTERA_AVALON_TIMER_CONTROL_STOP_MSK          (0x8)
+
+#define IORD_ALTERA_AVALON_TIMER_PERIODL(base)        IORD(base, 2)
+#define IOWR_ALTERA_AVALON_TIMER_PERIODL(base, data)  IOWR(base, 2, data)
+#define IORD_ALTERA_AVALON_TIMER_PERIODH(base)        IORD(base, 3)
+#define IOWR_ALTERA_AVALON_TIMER_PERIODH(base, data)  IOWR(base, 3, data)
+
+#define IORD_ALTERA_AVALON_TIMER_SNAPL(base)          IORD(base, 4)
+#define IOWR_ALTERA_AVALON_TIMER_SNAPL(base, data)    IOWR(base, 4, data)
+#define IORD_ALTERA_AVALON_TIMER_SNAPH(base)          IORD(base, 5)
+#define IOWR_ALTERA_AVALON_TIMER_SNAPH(base, data)    IOWR(base, 5, data)
+
+#endif /*ALTERA_AVALON_TIMER_REGS_H_*/
@@ -0,0 +1,14 @@
+#ifndef IO_H_
+#define IO_H_
+
+/*
+ * Host stand-in for the HAL register access macros. Instead of stwio/ldwio
+ * on the Avalon bus, every access goes to the device models in hal_host.c.
+ */
+unsigned int host_iord(unsigned int base, int regnum);
+void host_iowr(unsigned int base, int regnum, unsigned int data);
+
+#define IORD(BASE, REGNUM)       host_iord((unsigned int)(BASE), (REGNUM))
+#define IOWR(BASE, REGNUM, DATA) host_iowr((unsigned int)(BASE), (REGNUM), (unsigned int)(DATA))
+
+#endif /*IO_H_*/
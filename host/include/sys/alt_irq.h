@@ -0,0 +1,11 @@
+#ifndef ALT_IRQ_H_
+#define ALT_IRQ_H_
+
+#include "alt_types.h"
+
+/* Host stand-in for the legacy HAL interrupt API. */
+typedef void (*alt_isr_func)(void* isr_context, alt_u32 id);
+
+int alt_irq_register(alt_u32 id, void* context, alt_isr_func handler);
+
+#endif /*ALT_IRQ_H_*/
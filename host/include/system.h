@@ -0,0 +1,31 @@
+#ifndef SYSTEM_H_
+#define SYSTEM_H_
+
+/*
+ * Host stand-in for the BSP generated system.h. Base addresses and IRQ
+ * numbers match the board the kernel was written for; they are only used
+ * as keys by the device models in hal_host.c.
+ */
+
+#define ALT_CPU_FREQ 50000000
+
+#define TIMER_BASE        0x20050a0
+#define TIMER_IRQ         0
+#define TIMER_FREQ        50000000
+#define TIMER_LOAD_VALUE  49999     /* 1 ms period */
+
+#define BUTTONS_BASE      0x2005000
+#define BUTTONS_IRQ       2
+
+#define LED_0_BASE        0x2005080
+#define LED_1_BASE        0x2005090
+#define LED_2_BASE        0x20050c0
+#define LED_COLOR_BASE    0x20050f0
+#define LED_COLOR_RESET_VALUE 0xff0000
+
+/* Built with SMP, each core is a thread: the variables of a core are
+ * thread local, and asm_x86_64.s reads them as such in every build */
+#define CORE_LOCAL        __thread
+#define SMP_IPI_IRQ       3
+
+#endif /*SYSTEM_H_*/
@@ -0,0 +1,189 @@
+/*
+ * Converts a kernel trace written by trace_dump (trace.h) to the Chrome
+ * trace event JSON format, which chrome://tracing and ui.perfetto.dev
+ * open.
+ *
+ * Each process is a thread of the trace, with a "run" slice for each
+ * time it had the CPU; interrupt handlers are threads of their own.
+ * Monitor operations and timeouts are instant events on the thread of
+ * the process concerned.
+ *
+ * usage: trace2json trace.bin > trace.json
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "trace.h"
+
+#define MAX_TRACKED	4096
+#define IRQ_TID		1000	/* thread of interrupt device d: IRQ_TID + d */
+#define UNKNOWN_TID	999		/* switches to a process created before the trace */
+
+/* Process values seen in TRACE_EV_CREATE records, and their pid */
+static unsigned int processValue[MAX_TRACKED];
+static int processPid[MAX_TRACKED];
+static int processCount = 0;
+
+/* threads that got a name */
+static char named[MAX_TRACKED];
+
+static int first = 1;
+
+static void emit(const char* fmt, double ts, int tid, const char* name) {
+	printf("%s\n  {\"name\":\"%s\",\"ph\":\"%s\",\"pid\":0,\"tid\":%d,\"ts\":%.3f%s}",
+			first ? "" : ",", name, fmt, tid, ts,
+			fmt[0] == 'i' ? ",\"s\":\"t\"" : "");
+	first = 0;
+}
+
+static void nameThread(int tid) {
+	if (tid < 0 || tid >= MAX_TRACKED || named[tid]) {
+		return;
+	}
+	named[tid] = 1;
+	printf("%s\n  {\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"",
+			first ? "" : ",", tid);
+	if (tid >= IRQ_TID) {
+		printf("irq %d", tid - IRQ_TID);
+	} else if (tid == UNKNOWN_TID) {
+		printf("unknown");
+	} else {
+		printf("process %d", tid);
+	}
+	printf("\"}}");
+	first = 0;
+}
+
+static int pidOf(unsigned int value) {
+	int i;
+	for (i = 0; i < processCount; ++i) {
+		if (processValue[i] == value) {
+			return processPid[i];
+		}
+	}
+	return UNKNOWN_TID;
+}
+
+static void created(int pid, unsigned int value) {
+	int i;
+	for (i = 0; i < processCount; ++i) {
+		if (processValue[i] == value || processPid[i] == pid) {
+			break;
+		}
+	}
+	if (i == processCount) {
+		if (processCount == MAX_TRACKED) {
+			return;
+		}
+		processCount++;
+	}
+	processValue[i] = value;
+	processPid[i] = pid;
+}
+
+int main(int argc, char** argv) {
+	TraceHeader header;
+	TraceRecord r;
+	FILE* f;
+	unsigned long long counts = 0;
+	unsigned int last = 0;
+	int running = -1;
+	int irqOpen[MAX_TRACKED - IRQ_TID] = {0};
+	double ts = 0;
+	unsigned int n, value;
+	char name[64];
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s trace.bin > trace.json\n", argv[0]);
+		return 1;
+	}
+	f = fopen(argv[1], "rb");
+	if (f == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	if (fread(&header, sizeof(header), 1, f) != 1
+			|| header.magic != TRACE_MAGIC || header.version != TRACE_VERSION) {
+		fprintf(stderr, "%s: not a version %d kernel trace\n", argv[1], TRACE_VERSION);
+		return 1;
+	}
+	/* the processes alive when the trace was dumped, for the switches to
+	 * processes whose creation is no longer in the ring */
+	for (n = 0; n < header.processes; ++n) {
+		if (fread(&value, sizeof(value), 1, f) != 1) {
+			fprintf(stderr, "%s: truncated\n", argv[1]);
+			return 1;
+		}
+		if (value != 0) {
+			created(n, value);
+		}
+	}
+	if (header.lost > 0) {
+		fprintf(stderr, "%u older records were overwritten\n", header.lost);
+	}
+
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	for (n = 0; n < header.count && fread(&r, sizeof(r), 1, f) == 1; ++n) {
+		/* timestamps wrap around; consecutive records are less than a
+		 * wrap apart */
+		if (n > 0) {
+			counts += r.time - last;
+		}
+		last = r.time;
+		ts = counts * 1e6 / header.frequency;
+
+		switch (r.type) {
+		case TRACE_EV_CREATE:
+			created(r.id, r.arg);
+			break;
+		case TRACE_EV_SWITCH:
+			if (running != -1) {
+				emit("E", ts, running, "run");
+			}
+			running = pidOf(r.arg);
+			nameThread(running);
+			emit("B", ts, running, "run");
+			break;
+		case TRACE_EV_MON_ENTER:
+		case TRACE_EV_MON_BLOCK:
+		case TRACE_EV_MON_EXIT:
+		case TRACE_EV_MON_WAIT:
+		case TRACE_EV_MON_NOTIFY:
+		case TRACE_EV_MON_NOTIFY_ALL: {
+			static const char* names[] = {"enter", "block", "exit", "wait",
+					"notify", "notifyAll"};
+			snprintf(name, sizeof(name), "%s monitor %d",
+					names[r.type - TRACE_EV_MON_ENTER], r.id);
+			nameThread(r.arg);
+			emit("i", ts, r.arg, name);
+			break;
+		}
+		case TRACE_EV_TIMEOUT:
+			nameThread(r.id);
+			emit("i", ts, r.id, "timeout");
+			break;
+		case TRACE_EV_IRQ_ENTER:
+		case TRACE_EV_IRQ_EXIT:
+			if (IRQ_TID + r.id >= MAX_TRACKED) {
+				break;
+			}
+			nameThread(IRQ_TID + r.id);
+			/* an exit without its entry, at the start of the ring */
+			if (r.type == TRACE_EV_IRQ_EXIT && !irqOpen[r.id]) {
+				break;
+			}
+			irqOpen[r.id] = r.type == TRACE_EV_IRQ_ENTER;
+			emit(irqOpen[r.id] ? "B" : "E", ts, IRQ_TID + r.id, "irq");
+			break;
+		default:
+			fprintf(stderr, "unknown record type %d\n", r.type);
+			break;
+		}
+	}
+	if (running != -1) {
+		emit("E", ts, running, "run");
+	}
+	printf("\n]}\n");
+	fclose(f);
+	return 0;
+}
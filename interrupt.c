@@ -9,59 +9,117 @@
 #include "interrupt.h"
 #include "assembly.h"
 #include "system_m.h"
+#include "trace.h"
 
 
 
-typedef struct ListElem{
+/* Waiters of each device, linked through the InterruptWaiter nodes that
+ * iotransfer keeps on the stacks of the waiting processes. */
+typedef struct {
+    InterruptWaiter* head;
+    InterruptWaiter* tail;
+} WaiterQueue;
 
-    Process p;
-    struct ListElem* next;
-    
-} ListElem;
-
-ListElem* interruptVector[2]={NULL,NULL};
+static WaiterQueue interruptVector[NUM_INTERRUPT_DEVICES];
 
 
 Process removeHeadI(int i){
     
-    ListElem* removed = interruptVector[i];
-    if(interruptVector[i] != NULL){
-        interruptVector[i] = interruptVector[i] -> next;
+    InterruptWaiter* removed = interruptVector[i].head;
+    if(removed == NULL){
+        return NULL;
     }
-    if(removed != NULL){
-        Process result = removed -> p; 
-		free(removed); 
-		return result;
+    interruptVector[i].head = removed -> next;
+    if(interruptVector[i].head == NULL){
+        interruptVector[i].tail = NULL;
     }
-    else{
-        Process result = NULL;
-        return result;
-    }  
+    return removed -> p;
 }
 
-void insertTail(int i, Process toBeInserted){
+void insertTail(int i, InterruptWaiter* waiter){
     
-    ListElem* elem = malloc(sizeof(ListElem));
-    elem -> p = toBeInserted;
-    elem -> next = NULL;
-    
-    ListElem* temp= NULL;
-    if(interruptVector[i] == NULL){
-        
-       interruptVector[i] = elem; 
+    if(i < 0 || i >= NUM_INTERRUPT_DEVICES){
+        fprintf(stderr, "Error: no interrupt device %d\n", i);
+        exit(1);
+    }
+    waiter -> next = NULL;
+    if(interruptVector[i].tail == NULL){
+        interruptVector[i].head = waiter;
     }
     else{
-        
-        temp = interruptVector[i];
-        while((temp -> next) != NULL){
-        
-            temp = temp -> next;
-        }
-        temp -> next = elem;  
-    
+        interruptVector[i].tail -> next = waiter;
     }
-    
-        
+    interruptVector[i].tail = waiter;
+}
+
+/* Events of each device, written by its interrupt handler only. Indices
+ * run freely and are reduced modulo INTERRUPT_RING_SIZE on access. */
+typedef struct {
+    InterruptEvent events[INTERRUPT_RING_SIZE];
+    volatile unsigned int head;     /* next event to write, moved by the handler */
+    volatile unsigned int tail;     /* next event to read, moved by the reader */
+    volatile unsigned int dropped;
+} EventRing;
+
+static EventRing eventRings[NUM_INTERRUPT_DEVICES];
+
+/* keeps the compiler from moving ring accesses across index updates */
+#define COMPILER_BARRIER() __asm__ volatile ("" ::: "memory")
+
+void interrupt_post(int device, unsigned int data)
+{
+    EventRing* ring = &eventRings[device];
+    unsigned int head = ring->head;
+
+    if (head - ring->tail < INTERRUPT_RING_SIZE) {
+        ring->events[head & (INTERRUPT_RING_SIZE - 1)].time = clock_now();
+        ring->events[head & (INTERRUPT_RING_SIZE - 1)].stamp = clock_timestamp();
+        ring->events[head & (INTERRUPT_RING_SIZE - 1)].data = data;
+        COMPILER_BARRIER();
+        ring->head = head + 1;
+    } else {
+        ring->dropped++;
+    }
+
+    TRACE_IRQ_EXIT(device);
+#ifdef SMP
+    /* the waiters are queued by kernel calls, which hold kernel_lock */
+    spin_lock(&kernel_lock);
+#endif
+    Process p2 = removeHeadI(device);
+    if(p2 != NULL){
+        transfer(p2);
+    }
+#ifdef SMP
+    spin_unlock(&kernel_lock);
+#endif
+}
+
+int interrupt_pending(int device)
+{
+    return eventRings[device].head - eventRings[device].tail;
+}
+
+int interrupt_read(int device, InterruptEvent* events, int max)
+{
+    EventRing* ring = &eventRings[device];
+    unsigned int tail = ring->tail;
+    unsigned int head = ring->head;
+    int n = 0;
+
+    COMPILER_BARRIER();
+    while (tail != head && n < max) {
+        events[n++] = ring->events[tail & (INTERRUPT_RING_SIZE - 1)];
+        tail++;
+    }
+    COMPILER_BARRIER();
+    ring->tail = tail;
+    return n;
+}
+
+unsigned int interrupt_dropped(int device)
+{
+    return eventRings[device].dropped;
 }
 
 /* A variable to hold the value of the button pio edge capture register. */
@@ -76,6 +134,9 @@ void handle_button_interrupts(void* context, alt_u32 id)
      */
     volatile int* edge_capture_ptr = (volatile int*) context;
     
+    irq_masked_begin();
+    TRACE_IRQ_ENTER(1);
+    
     /* Store the value in the Button's edge capture register in *context. */
     *edge_capture_ptr = IORD_ALTERA_AVALON_PIO_EDGE_CAP(BUTTONS_BASE);
 	/* Reset the edge capture register. */
@@ -85,13 +146,8 @@ void handle_button_interrupts(void* context, alt_u32 id)
      * with high processor -> pio latency and fast interrupts.  */
     IORD_ALTERA_AVALON_PIO_EDGE_CAP(BUTTONS_BASE);
     
-    Process p2 = removeHeadI(1);
-   
-    if(p2 != NULL){
-        
-        transfer(p2);
-       
-    }
+    interrupt_post(1, *edge_capture_ptr);
+    irq_masked_end();
 }
 
 /* Initialize the button_pio. */
@@ -115,20 +171,112 @@ void init_button()
 /* A variable to set up context for timer interrupt. */
 volatile int timer_capture = 0;
 
+/* Timer counts in one clock period (the BSP timer period) */
+#define CLOCK_COUNTS (TIMER_LOAD_VALUE + 1)
+
+/* Counts in the period currently programmed */
+static alt_u32 clock_period_counts = CLOCK_COUNTS;
+
+/* Counts from the last clock interrupt to the start of that period */
+static alt_u32 clock_offset = 0;
+
+/* Clock periods up to the last clock interrupt, and periods from it to the
+ * next one */
+static alt_u32 clock_ticks = 0;
+static alt_u32 clock_programmed = 1;
+
+static alt_u32 clock_counts();
+
+/* Built with SMP, the clock interrupts core 0 and the other cores read
+ * the time too: the timer snapshot and the clock variables are shared */
+#ifdef SMP
+static SpinLock clock_lock = 0;
+#define clock_lock_take() spin_lock(&clock_lock)
+#define clock_lock_give() spin_unlock(&clock_lock)
+#else
+#define clock_lock_take()
+#define clock_lock_give()
+#endif
+
+/* Kernel function called by the clock interrupt */
+static void (*clock_tick)(unsigned int ticks);
+
+#ifdef IRQ_LATENCY
+/* Start of the masked window of each core, if it is timed; the windows
+ * opened before init_clock are not */
+static CORE_LOCAL unsigned int irq_masked_since;
+static CORE_LOCAL int irq_masked_open = 0;
+static int irq_masked_timing = 0;
+
+/* Longest window and number of windows of each length class */
+static unsigned int irq_masked_longest = 0;
+static unsigned int irq_masked_classes[IRQ_LATENCY_CLASSES];
+
+void irq_masked_begin()
+{
+  if (irq_masked_timing) {
+    irq_masked_since = clock_timestamp();
+    irq_masked_open = 1;
+  }
+}
+
+void irq_masked_end()
+{
+  if (!irq_masked_open) {
+    return;
+  }
+  unsigned int window = clock_timestamp() - irq_masked_since;
+  int class = 0;
+  irq_masked_open = 0;
+  while (class < IRQ_LATENCY_CLASSES - 1 && (window >> (class + 1)) != 0) {
+    class++;
+  }
+  clock_lock_take();
+  irq_masked_classes[class]++;
+  if (window > irq_masked_longest) {
+    irq_masked_longest = window;
+  }
+  clock_lock_give();
+}
+
+unsigned int irq_masked_max()
+{
+  return irq_masked_longest;
+}
+
+int irq_masked_histogram(unsigned int* counts)
+{
+  int class;
+  for (class = 0; class < IRQ_LATENCY_CLASSES; ++class) {
+    counts[class] = irq_masked_classes[class];
+  }
+  return IRQ_LATENCY_CLASSES;
+}
+#endif
+
 void handle_timer_interrupts(void* context, alt_u32 id)
 {
+	irq_masked_begin();
+	TRACE_IRQ_ENTER(0);
+	clock_lock_take();
 	/* clear the interrupt */
 	IOWR_ALTERA_AVALON_TIMER_STATUS (TIMER_BASE, 0);
+	clock_offset = 0;
+	alt_u32 ticks = clock_programmed;
+	clock_ticks += ticks;
+	clock_lock_give();
 
-	Process p2 = removeHeadI(0);
-    if(p2 != NULL){
-        transfer(p2);
-    }
+	TRACE_IRQ_EXIT(0);
+	/* may transfer to another process, and come back here when this one
+	 * runs again */
+	clock_tick(ticks);
+	irq_masked_end();
 }
 
-void init_clock()
+void init_clock(void (*tick)(unsigned int ticks))
 {
-    
+  clock_tick = tick;
+
   void* timer_capture_ptr = (void*) &timer_capture;  
   /* set to free running mode */
   IOWR_ALTERA_AVALON_TIMER_CONTROL (TIMER_BASE, 
@@ -138,12 +286,82 @@ void init_clock()
 
   /* register the interrupt handler, and enable the interrupt */ 
   alt_irq_register (TIMER_IRQ, timer_capture_ptr, handle_timer_interrupts);  
+
+#ifdef IRQ_LATENCY
+  irq_masked_timing = 1;
+#endif
   
 }
 
+/* Latches the counter, which counts down from period - 1 */
+static alt_u32 clock_snapshot()
+{
+  IOWR_ALTERA_AVALON_TIMER_SNAPL (TIMER_BASE, 0);
+  return IORD_ALTERA_AVALON_TIMER_SNAPL (TIMER_BASE)
+          | (IORD_ALTERA_AVALON_TIMER_SNAPH (TIMER_BASE) << 16);
+}
 
+/* Counts since the last clock interrupt */
+static alt_u32 clock_counts()
+{
+  alt_u32 snap = clock_snapshot();
+  alt_u32 counts = clock_offset;
 
+  /* the period ended while interrupts were masked; it may have ended
+   * just after the snapshot, so take it again in the next period */
+  if (IORD_ALTERA_AVALON_TIMER_STATUS (TIMER_BASE) & ALTERA_AVALON_TIMER_STATUS_TO_MSK) {
+    snap = clock_snapshot();
+    counts += clock_period_counts;
+  }
+  return counts + clock_period_counts - 1 - snap;
+}
 
+unsigned int clock_elapsed()
+{
+  return clock_counts() / CLOCK_COUNTS;
+}
 
+/* both read clock_ticks and the timer with interrupts masked: a clock
+ * interrupt in between would count its period twice, or not at all */
+unsigned int clock_now()
+{
+  int state = saveInterrupts();
+  clock_lock_take();
+  unsigned int now = clock_ticks + clock_elapsed();
+  clock_lock_give();
+  restoreInterrupts(state);
+  return now;
+}
 
+unsigned int clock_timestamp()
+{
+  int state = saveInterrupts();
+  clock_lock_take();
+  unsigned int stamp = clock_ticks * CLOCK_COUNTS + clock_counts();
+  clock_lock_give();
+  restoreInterrupts(state);
+  return stamp;
+}
+
+int program_clock(unsigned int ticks)
+{
+  if (IORD_ALTERA_AVALON_TIMER_STATUS (TIMER_BASE) & ALTERA_AVALON_TIMER_STATUS_TO_MSK) {
+    return 0;
+  }
+
+  alt_u32 elapsed = clock_counts();
+  alt_u32 counts = ticks * CLOCK_COUNTS;
+  counts = counts > elapsed ? counts - elapsed : 1;
+  clock_offset = elapsed;
+  clock_period_counts = counts;
+  clock_programmed = ticks;
 
+  /* writing the period stops the timer */
+  IOWR_ALTERA_AVALON_TIMER_PERIODL (TIMER_BASE, (counts - 1) & 0xffff);
+  IOWR_ALTERA_AVALON_TIMER_PERIODH (TIMER_BASE, (counts - 1) >> 16);
+  IOWR_ALTERA_AVALON_TIMER_CONTROL (TIMER_BASE,
+            ALTERA_AVALON_TIMER_CONTROL_ITO_MSK  |
+            ALTERA_AVALON_TIMER_CONTROL_CONT_MSK |
+            ALTERA_AVALON_TIMER_CONTROL_START_MSK);
+  return 1;
+}
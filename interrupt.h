@@ -3,21 +3,126 @@
 
 #include "system_m.h"
 
+#ifdef STATIC_CONFIG
+#include "kernelConfig.h"
+#endif
+
 /* Function that enables all 4 button interrupts and that resets the edge capture register. */
 void init_button();
 
-/* Function that enables clock interrupts. */
-void init_clock();
+/* Function that enables clock interrupts. Their handler calls tick, on the
+ * stack of the process it interrupted, with the clock periods elapsed
+ * since the previous one; tick may transfer to another process. */
+void init_clock(void (*tick)(unsigned int ticks));
+
+/* Tickless mode: program the next clock interrupt ticks clock periods
+ * after the last one. Returns 0, leaving the clock unchanged, if the clock
+ * interrupt is already pending. */
+int program_clock(unsigned int ticks);
+
+/* Tickless mode: number of whole clock periods elapsed since the last
+ * clock interrupt, read from the timer snapshot. */
+unsigned int clock_elapsed();
+
+/* Number of interrupt devices a process can wait on: 0 is the clock,
+ * 1 the buttons. */
+#ifndef NUM_INTERRUPT_DEVICES
+#define NUM_INTERRUPT_DEVICES 2
+#endif
+
+/* A process waiting for an interrupt. The node belongs to the waiting
+ * process (iotransfer keeps it on its stack), so queueing allocates nothing. */
+typedef struct InterruptWaiter {
+    Process p;
+    struct InterruptWaiter* next;
+} InterruptWaiter;
+
+/* Functions used in implementation of iotransfer and of the interrupt
+ * handlers. Both are O(1). */ 
+void insertTail(int i, InterruptWaiter* waiter);
+Process removeHeadI(int i);
+
+/* An interrupt recorded by its handler: time in clock periods since
+ * init_clock, the same time as a clock_timestamp for latency
+ * measurements, and device specific data (the edge capture bits for the
+ * buttons). */
+typedef struct {
+    unsigned int time;
+    unsigned int stamp;
+    unsigned int data;
+} InterruptEvent;
+
+/* Events kept per device until they are read (power of two). */
+#ifndef INTERRUPT_RING_SIZE
+#define INTERRUPT_RING_SIZE 16
+#endif
+
+/* Called by an interrupt handler: records an event in the ring of the
+ * device and transfers to the first process waiting on the device, if any.
+ * When the ring is full the event is dropped and counted. */
+void interrupt_post(int device, unsigned int data);
 
-/* Function used in implementation of iotransfer. */ 
-void insertTail(int i, Process toBeInserted);
+/* Number of events of the device not read yet. */
+int interrupt_pending(int device);
+
+/* Takes up to max events of the device, oldest first, and returns how many
+ * were taken. Lock free against interrupt_post; a device must have only
+ * one reader. */
+int interrupt_read(int device, InterruptEvent* events, int max);
+
+/* Number of events of the device dropped because its ring was full. */
+unsigned int interrupt_dropped(int device);
+
+/* Clock periods since init_clock. */
+unsigned int clock_now();
+
+/* Timer counts (TIMER_FREQ per second) since init_clock, wrapping around;
+ * used to timestamp trace records. */
+unsigned int clock_timestamp();
 
 extern volatile int edge_capture;
 
+/* Built with IRQ_LATENCY, every window in which interrupts stay masked is
+ * timed with clock_timestamp, from the outermost maskInterrupts or
+ * saveInterrupts, or the entry of an interrupt handler of the kernel, to
+ * the allowInterrupts or restoreInterrupts, or the handler exit, that
+ * allows them again. irq_masked_begin and irq_masked_end mark these
+ * points, with interrupts masked; outside that build they are empty.
+ * The handlers of the BSP itself are not timed, and each window costs two
+ * timer reads.
+ *
+ * irq_masked_max is the longest window since init_clock, in timer counts.
+ * irq_masked_histogram copies the number of windows of each length class
+ * into counts and returns IRQ_LATENCY_CLASSES: class 0 holds the windows
+ * of 0 or 1 count, class i > 0 those of 2^i to 2^(i+1) - 1 counts. */
+#define IRQ_LATENCY_CLASSES 32
+#ifdef IRQ_LATENCY
+void irq_masked_begin();
+void irq_masked_end();
+#else
+#define irq_masked_begin()
+#define irq_masked_end()
+#endif
+unsigned int irq_masked_max();
+int irq_masked_histogram(unsigned int* counts);
+
 /* Function that masks all interrupts. */
 void maskInterrupts();
 
 /* Function that allows all interrupts. */
 void allowInterrupts();
 
+/* Masks all interrupts and returns the previous state, to be given back
+ * to restoreInterrupts: unlike maskInterrupts / allowInterrupts, critical
+ * sections made this way nest, and one entered with interrupts masked
+ * leaves them masked. */
+int saveInterrupts();
+
+/* Puts back the state returned by saveInterrupts. */
+void restoreInterrupts(int state);
+
+/* Function that idles until the next interrupt (returns at once on Nios II,
+ * which has no wait instruction). */
+void waitForInterrupt();
+
 #endif /*INTERRUPT_H_*/
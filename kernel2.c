@@ -1,325 +1,2152 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <system.h>
 #include "system_m.h"
 #include "interrupt.h"
 #include "kernel2.h"
+#include "stackpool.h"
+#include "trace.h"
 
 /************* Symbolic constants and macros ************/
+/*
+ * Built with SMP, the kernel runs on NUM_CORES cores (smp.h). Each core
+ * has its own ready queues and idle process, and runs the head of its
+ * queues; a core with nothing to run takes a ready process from another
+ * one, and a process made ready on another core interrupts that core if
+ * it must run there now. Kernel calls and the kernel parts of interrupt
+ * handlers hold kernel_lock (system_m.h), a single lock over the whole
+ * kernel state: on Nios II every spin lock goes through the one hardware
+ * mutex anyway. The clock and the buttons interrupt core 0, and processes
+ * that wait for interrupts move to core 0 for good.
+ */
+#ifdef SMP
+#if defined(TICKLESS) || TRACE_CATEGORIES
+#error "SMP is built without TICKLESS and without tracing"
+#endif
+#define CORES				NUM_CORES
+#define thisCore()			core_id()
+#define coreOf(pid)			processes[pid].core
+#define lockKernel()		spin_lock(&kernel_lock)
+#define unlockKernel()		spin_unlock(&kernel_lock)
+#else
+#define CORES				1
+#define thisCore()			0
+#define coreOf(pid)			0
+#define lockKernel()
+#define unlockKernel()
+#endif
+
+/* Built with STATIC_CONFIG, the tables fit the objects of kernelConfig.h
+ * exactly; a kind of object not configured keeps a table of one, so that
+ * no array is empty */
+#ifdef STATIC_CONFIG
+#define CONFIG_TABLE(count) ((count) > 0 ? (count) : 1)
+#define MAX_PROC (CONFIG_PROCESS_COUNT + CONFIG_DYNAMIC_PROCESSES + CORES)	/* and idle */
+#define MAX_MONITORS CONFIG_TABLE(CONFIG_MONITOR_COUNT)
+#define MAX_CONDITIONS CONFIG_TABLE(CONFIG_CONDITION_COUNT)
+#define MAX_MAILBOXES CONFIG_TABLE(CONFIG_MAILBOX_COUNT)
+#define MAX_SEMAPHORES CONFIG_TABLE(CONFIG_SEMAPHORE_COUNT)
+#define MAX_EVENT_FLAGS CONFIG_TABLE(CONFIG_EVENT_FLAGS_COUNT)
+#define MAX_RW_MONITORS CONFIG_TABLE(CONFIG_RW_MONITOR_COUNT)
+#define CONFIG_CAPACITY(name, capacity)	+ (capacity)
+#define MAILBOX_POOL_SIZE CONFIG_TABLE(0 CONFIG_MAILBOXES(CONFIG_CAPACITY))
+#endif
+#ifndef MAX_PROC
 #define MAX_PROC 10
+#endif
+#ifndef MAX_MONITORS
 #define MAX_MONITORS 10
-
-#define DPRINTA(text, ...) printf("[%d] " text "\n", head(&readyList), __VA_ARGS__)
+#endif
+#ifndef MAX_CONDITIONS
+#define MAX_CONDITIONS 20		/* created by createCondition, shared by all monitors */
+#endif
+#ifndef MAX_MAILBOXES
+#define MAX_MAILBOXES 10
+#endif
+#ifndef MAX_SEMAPHORES
+#define MAX_SEMAPHORES 10
+#endif
+#ifndef MAX_EVENT_FLAGS
+#define MAX_EVENT_FLAGS 10
+#endif
+#ifndef MAX_RW_MONITORS
+#define MAX_RW_MONITORS 10
+#endif
+#ifndef MAILBOX_POOL_SIZE
+#define MAILBOX_POOL_SIZE 256	/* messages, shared by all the mailboxes */
+#endif
+#ifndef NUM_PRIORITIES
+#define NUM_PRIORITIES 8		/* at most 31, one bit each in readyBitmap */
+#endif
+#define DEFAULT_PRIORITY (NUM_PRIORITIES / 2)
+#define EDF_PRIORITY -1			/* periodic processes, above every priority */
+#ifndef EDF_MAX_UTILIZATION
+#define EDF_MAX_UTILIZATION 100	/* percent of the CPU periodic processes may reserve */
+#endif
+#define EDF_UTILIZATION_ONE (1 << 16)	/* fixed point utilization of a whole CPU */
+
+/* Stacks are painted with STACK_PAINT when a process is created, so that
+ * stackHighWater can find the deepest word used, and their lowest words
+ * hold STACK_CANARY, which is checked each time the process is switched
+ * out. Build with -DSTACK_CHECK=0 to skip the check. */
+#ifndef STACK_CHECK
+#define STACK_CHECK 1
+#endif
+#define STACK_PAINT			0xA5A5A5A5
+#define STACK_CANARY		0x5AC0FFEE
+#define STACK_CANARY_WORDS	4
+#ifndef STACK_REPORT_MARGIN
+#define STACK_REPORT_MARGIN	128		/* bytes recommended above the high water mark, plus a quarter */
+#endif
+
+#define DPRINTA(text, ...) printf("[%d] " text "\n", readyHead(), __VA_ARGS__)
 #define DPRINT(text) DPRINTA(text, 0)
-#define ERRA(text, ...) fprintf(stderr, "[%d] Error: " text "\n", head(&readyList), __VA_ARGS__)
-#define ERR(text) { ERRA(text, 0); int i; for(i = 0; i < 75000; ++i){} }
+#define ERRA(text, ...) fprintf(stderr, "[%d] Error: " text "\n", readyHead(), __VA_ARGS__)
+#define ERR(text) ERRA(text, 0)
 
 /************* Data structures **************/
+
+/* Doubly linked list of processes, threaded through ProcessDescriptor.next/prev */
+typedef struct {
+	int head;
+	int tail;
+} ProcessList;
+
+/* Processes waiting for a condition of a monitor */
+typedef struct {
+	ProcessList waitingList;
+	int notifyAllEpoch;			/* incremented each time notifyAll empties waitingList */
+} ConditionQueue;
+
+/* Process descriptor states */
+#define PROC_FREE	0		/* slot not in use, on freeProcesses once used */
+#define PROC_ALIVE	1
+#define PROC_EXITED	2		/* SMP: exited, its stack given back by the next allocProcess */
+
+/* Times of the CPU accounting are only measured when built with
+ * PROCESS_STATS, as reading the timer at every switch and wakeup is not
+ * free; the switch counts are always kept. */
+#ifdef PROCESS_STATS
+#define statsTimestamp()	clock_timestamp()
+#else
+#define statsTimestamp()	0
+#endif
+
+/* What an alive process is doing, for the CPU accounting */
+#define RUN_READY	0		/* in a ready queue, running or not */
+#define RUN_BLOCKED	1
+#define RUN_MONITOR	2		/* blocked entering or waiting in a monitor */
+
 typedef struct {
 	int next;
+	int prev;
 	Process p;
+	int state;
+	unsigned int* stack;		/* block of the stack pool */
+	int stackSize;				/* bytes asked for by the creator */
+	int stackBlockSize;			/* bytes of the block */
+	int stackPooled;			/* the stack is given back to the pool at exit */
+	ProcessList joiners;		/* processes blocked in joinProcess on this one */
+	int priority;				/* 0 is the highest priority, EDF_PRIORITY if periodic */
+	int basePriority;			/* priority at creation, restored by the MLFQ boost */
+	unsigned int sliceUsed;		/* ms of its quantum used, charged at clock interrupts */
+	unsigned int period;		/* periodic processes: period in ticks, 0 otherwise */
+	unsigned int utilization;	/* budget / period, out of EDF_UTILIZATION_ONE */
+	unsigned int release;		/* release tick of the current job */
+	unsigned int deadline;		/* absolute deadline of the current job, in ticks */
+	unsigned int deadlineMisses;	/* jobs completed after their deadline */
 	int currentMonitor;			/* points to the monitors array */
 	int monitors[MAX_MONITORS + 1]; /* used for nested calls; monitors[0] is always -1 */
-	int timeout;
+	unsigned int timerExpires;	/* absolute tick at which the timeout fires */
+	int timerSlot;				/* timer wheel slot holding the process */
+	int timerNext;				/* links in the timer wheel slot */
+	int timerPrev;
+	int timerMonitor;			/* monitor waited on by timedWait, -1 otherwise */
+	ConditionQueue* waitQueue;	/* condition queue waited on by timedWait */
+	ProcessList* timerList;		/* list waited on by a timed blockOn */
+	unsigned int flagsWanted;	/* waitEventFlags: bits waited for */
+	int flagsMode;				/* waitEventFlags: EVENT_FLAGS_* options */
+	unsigned int flagsGot;		/* flags that satisfied the wait */
+	int waitEpoch;				/* notifyAll epoch of waitQueue when wait was called */
+	unsigned int rwTicket;		/* arrival order in the queues of a reader-writer monitor */
+	unsigned char rwShared[MAX_RW_MONITORS];	/* times inside each reader-writer monitor in shared mode */
+	int runState;				/* RUN_READY, RUN_BLOCKED or RUN_MONITOR */
+	unsigned int runSince;		/* clock_timestamp of the last switch to the process */
+	unsigned int stateSince;	/* clock_timestamp of the last change of runState */
+	unsigned long long runCounts;	/* timer counts spent running */
+	unsigned long long readyCounts;	/* ready but not running */
+	unsigned long long monitorCounts;	/* in RUN_MONITOR */
+	unsigned int voluntarySwitches;	/* switched out blocking */
+	unsigned int involuntarySwitches;	/* switched out while still ready */
+#ifdef SMP
+	int core;					/* core whose ready queues it goes to */
+	int pinned;					/* never taken by another core */
+	void (*entry)();			/* function of the process, called by processStart */
+#endif
 } ProcessDescriptor;
 
 typedef struct {
 	int timesTaken;
 	int takenBy;
-	int entryList;
-	int waitingList;
+	ProcessList entryList;
+	ProcessList notifiedList;	/* MONITOR_HANDOFF: notified, let in before entryList */
+	ConditionQueue condition;	/* used by wait, notify and notifyAll */
 } MonitorDescriptor;
 
+/* Reader-writer monitor: any number of readers, or one writer. The
+ * waiting readers and writers are queued apart; rwTicket keeps their
+ * order of arrival for the FIFO policy. */
+typedef struct {
+	int policy;					/* RW_WRITER_PREFERRING or RW_FIFO */
+	int readers;				/* processes inside in shared mode */
+	int writer;					/* process inside in exclusive mode, -1 if none */
+	ProcessList readWaiters;
+	ProcessList writeWaiters;
+	unsigned int nextTicket;
+} RWMonitorDescriptor;
+
+/* Additional condition of a monitor, used by waitOn and signalCondition */
+typedef struct {
+	int monitor;
+	ConditionQueue queue;
+} ConditionDescriptor;
+
+typedef struct {
+	int count;
+	ProcessList waiters;
+} SemaphoreDescriptor;
+
+typedef struct {
+	unsigned int flags;
+	ProcessList waiters;
+} EventFlagsDescriptor;
+
+/* Bounded queue of messages, a ring in mailboxPool */
+typedef struct {
+	int* messages;
+	int capacity;
+	int first;					/* oldest message */
+	int count;
+	ProcessList senders;		/* blocked because the mailbox is full */
+	ProcessList receivers;		/* blocked because it is empty */
+} MailboxDescriptor;
+
 /********************** Global variables **********************/
 
-/* Pointer to the head of the ready list */
-static int readyList = -1;
+/* One ready queue per priority level, level 0 holding the periodic
+ * processes in deadline order and level p + 1 the processes of priority p,
+ * for each core. The running process is always the head of the highest
+ * priority non empty queue of its core; with SMP, only until the core
+ * takes the interrupt sent when another core readies a process before it. */
+static ProcessList readyQueues[CORES][NUM_PRIORITIES + 1] =
+		{[0 ... CORES - 1] = {[0 ... NUM_PRIORITIES] = {-1, -1}}};
+
+/* Bit i of readyBitmap[core] is set when readyQueues[core][i] is not empty */
+static unsigned int readyBitmap[CORES];
+
+/* Sum of the utilizations of the periodic processes */
+static unsigned int edfUtilization = 0;
 
 /* List of process descriptors */
 ProcessDescriptor processes[MAX_PROC];
 static int nextProcessId = 0;
 
+/* Descriptors of exited processes, reused first */
+static ProcessList freeProcesses = {-1, -1};
+
+/* Process that has each core, as last accounted by accountSwitch */
+static int runningPid[CORES] = {[0 ... CORES - 1] = -1};
+
+#ifdef SMP
+/* The process of a kernel call, or interrupted by a handler */
+#define currentPid()	runningPid[thisCore()]
+
+/* Set once the cores may be interrupted; an interrupt is pending on the
+ * cores with kickPending set */
+static int kernelStarted = 0;
+static volatile int kickPending[CORES];
+
+/* Core given to the next process created */
+static int nextCore = 0;
+
+/* Processes taken from another core, and interrupts sent to cores */
+static unsigned int steals = 0;
+static unsigned int kicks = 0;
+
+/* Exited processes whose stack may still be in use */
+static ProcessList exitedProcesses = {-1, -1};
+#else
+#define currentPid()	readyHead()
+#endif
+
+/* Clock interrupts handled, and the time spent in them */
+static unsigned int clockInterrupts = 0;
+static unsigned long long tickCounts = 0;
+
 /* List of monitor descriptors */
 MonitorDescriptor monitors[MAX_MONITORS];
 static int nextMonitorId = 0;
 
+/* List of condition descriptors */
+ConditionDescriptor conditions[MAX_CONDITIONS];
+static int nextConditionId = 0;
+
+/* List of semaphore and event flag group descriptors */
+SemaphoreDescriptor semaphores[MAX_SEMAPHORES];
+static int nextSemaphoreId = 0;
+EventFlagsDescriptor eventFlags[MAX_EVENT_FLAGS];
+static int nextEventFlagsId = 0;
+RWMonitorDescriptor rwMonitors[MAX_RW_MONITORS];
+static int nextRWMonitorId = 0;
+
+/* List of mailbox descriptors, and the storage of their messages */
+MailboxDescriptor mailboxes[MAX_MAILBOXES];
+static int nextMailboxId = 0;
+static int mailboxPool[MAILBOX_POOL_SIZE];
+static int mailboxPoolUsed = 0;
+
 /* Part 2 of the project variables and data structures */
-#define STACK_SIZE	10000
+/* Stack of the idle process; it never runs process code */
+#ifndef SPECIAL_STACK_SIZE
+#define SPECIAL_STACK_SIZE	STACK_CLASS_0_SIZE
+#endif
 #define TIME_SLICING_FREQUENCY	20 // ms
 #define CLOCK_PERIOD 1 // ms
 
-int idle_pid;
-int scheduler_pid;
+/*
+ * Multilevel feedback queue, built with MLFQ. The priority given at
+ * creation is the level a process starts at. A process that runs for the
+ * whole quantum of its level drops to the level below, whose quantum is
+ * longer; one that blocks before starts its next quantum afresh at the
+ * same level. Every MLFQ_BOOST_PERIOD ms every process goes back to its
+ * initial level, so that the lower levels do not starve. Without MLFQ,
+ * every level has the quantum TIME_SLICING_FREQUENCY and processes keep
+ * their priority.
+ */
+#ifdef MLFQ
+#ifndef MLFQ_QUANTA
+#define MLFQ_QUANTA			5, 10, 20, 40, 80, 160, 320, 640	/* ms, one per level */
+#endif
+#ifndef MLFQ_BOOST_PERIOD
+#define MLFQ_BOOST_PERIOD	1000	/* ms */
+#endif
+static const unsigned int levelQuanta[NUM_PRIORITIES] = {MLFQ_QUANTA};
+/* MLFQ_QUANTA must give a quantum to each of the NUM_PRIORITIES levels */
+typedef char mlfqQuantaCheck[sizeof((unsigned int[]){MLFQ_QUANTA}) == sizeof(levelQuanta) ? 1 : -1];
+#define quantumOf(priority)	levelQuanta[priority]
+#else
+#define quantumOf(priority)	TIME_SLICING_FREQUENCY
+#endif
+
+/* Idle process of each core */
+static int idlePids[CORES];
+
+/* Timer state of each process */
+#define TIMER_NONE		0
+#define TIMER_ARMED		1	/* in the timer wheel */
+#define TIMER_EXPIRED	2	/* timed out and not yet seen by timedWait */
 int timedWaiting[MAX_PROC] = {0};
 
+/*
+ * Hashed timer wheel for sleep and timedWait, in clock ticks.
+ * A timeout less than TIMER_WHEEL_SIZE ticks away is put in the slot
+ * (expiry % TIMER_WHEEL_SIZE); every process in the slot visited by a tick
+ * expires at that tick. Longer timeouts wait in the overflow slot, which
+ * is scanned once per wheel revolution to move the ones coming into range.
+ */
+#ifndef TIMER_WHEEL_SIZE
+#define TIMER_WHEEL_SIZE	64		/* power of two */
+#endif
+#define TIMER_OVERFLOW		TIMER_WHEEL_SIZE
+
+static ProcessList timerWheel[TIMER_WHEEL_SIZE + 1] = {[0 ... TIMER_WHEEL_SIZE] = {-1, -1}};
+
+/* Ticks since start() */
+static unsigned int currentTick = 0;
+
+#ifdef MLFQ
+/* Tick of the next priority boost */
+static unsigned int nextBoost;
+#endif
+
+/*
+ * Tickless mode: instead of interrupting every CLOCK_PERIOD, the clock is
+ * programmed to fire at the next timer expiry or end of time slice.
+ * currentTick is then the tick of the last clock interrupt, and the ticks
+ * elapsed since are read from the timer when a kernel call needs them.
+ */
+#ifdef TICKLESS
+#ifndef TICKLESS_MAX_TICKS
+#define TICKLESS_MAX_TICKS	1000
+#endif
+static int clockStarted = 0;
+static unsigned int clockProgrammed = 1;	/* ticks from currentTick to the next clock interrupt */
+#endif
+
 
 /*************** Functions for process list manipulation **********/
 
+/* All operations are O(1) except size */
+
 /* add element to the tail of the list */
-static void addLast(int* list, int processId) {
-	if (*list == -1){
-		*list = processId;
+static void addLast(ProcessList* list, int processId) {
+	processes[processId].next = -1;
+	processes[processId].prev = list->tail;
+	if (list->tail == -1){
+		list->head = processId;
 	}
 	else {
-		int temp = *list;
-		while (processes[temp].next != -1){
-			temp = processes[temp].next;
+		processes[list->tail].next = processId;
+	}
+	list->tail = processId;
+}
+
+/* add element to the head of list */
+static void addFirst(ProcessList* list, int processId){
+	processes[processId].prev = -1;
+	processes[processId].next = list->head;
+	if (list->head == -1){
+		list->tail = processId;
+	}
+	else {
+		processes[list->head].prev = processId;
+	}
+	list->head = processId;
+}
+
+int size(ProcessList* list) {
+	int i;
+	int pid = list->head;
+	for (i=0 ; pid != -1 ; i++) {
+		pid = processes[pid].next;
+	}
+
+	return i;
+}
+
+/* remove an element from the list it belongs to */
+static void removeFromList(ProcessList* list, int processId) {
+	int next = processes[processId].next;
+	int prev = processes[processId].prev;
+
+	if (prev == -1) {
+		list->head = next;
+	} else {
+		processes[prev].next = next;
+	}
+	if (next == -1) {
+		list->tail = prev;
+	} else {
+		processes[next].prev = prev;
+	}
+	processes[processId].next = -1;
+	processes[processId].prev = -1;
+}
+
+/* remove an element from the head of the list */
+static int removeHead(ProcessList* list){
+	if (list->head == -1){
+		return(-1);
+	}
+	else {
+		int head = list->head;
+		removeFromList(list, head);
+		return head;
+	}
+}
+
+/* move all the elements of src to the tail of dst, leaving src empty */
+static void appendList(ProcessList* dst, ProcessList* src) {
+	if (src->head == -1) {
+		return;
+	}
+	if (dst->head == -1) {
+		dst->head = src->head;
+	} else {
+		processes[dst->tail].next = src->head;
+		processes[src->head].prev = dst->tail;
+	}
+	dst->tail = src->tail;
+	src->head = -1;
+	src->tail = -1;
+}
+
+/* returns the head of the list */
+static int head(ProcessList* list){
+	return list->head;
+}
+
+/* checks if the list is empty */
+static int isEmpty(ProcessList* list) {
+	return list->head < 0;
+}
+
+/*************** Functions for the timer wheel **********/
+
+static void timerSlotAdd(int slot, int processId) {
+	ProcessList* list = &timerWheel[slot];
+	processes[processId].timerSlot = slot;
+	processes[processId].timerNext = -1;
+	processes[processId].timerPrev = list->tail;
+	if (list->tail == -1) {
+		list->head = processId;
+	} else {
+		processes[list->tail].timerNext = processId;
+	}
+	list->tail = processId;
+}
+
+static void timerSlotRemove(int processId) {
+	ProcessList* list = &timerWheel[processes[processId].timerSlot];
+	int next = processes[processId].timerNext;
+	int prev = processes[processId].timerPrev;
+
+	if (prev == -1) {
+		list->head = next;
+	} else {
+		processes[prev].timerNext = next;
+	}
+	if (next == -1) {
+		list->tail = prev;
+	} else {
+		processes[next].timerPrev = prev;
+	}
+}
+
+/* slot for a timer expiring at tick expires, seen from currentTick */
+static int timerSlotFor(unsigned int expires) {
+	if (expires - currentTick < TIMER_WHEEL_SIZE) {
+		return expires & (TIMER_WHEEL_SIZE - 1);
+	}
+	return TIMER_OVERFLOW;
+}
+
+/* arm a timeout of msec for processId */
+/* current tick; in tickless mode currentTick is the tick of the last
+ * clock interrupt, and the time since is read from the timer */
+static unsigned int nowTick() {
+#ifdef TICKLESS
+	if (clockStarted) {
+		return currentTick + clock_elapsed();
+	}
+#endif
+	return currentTick;
+}
+
+/* arm the timeout of processId for the absolute tick expires */
+static void addTimerAt(int processId, unsigned int expires) {
+	processes[processId].timerExpires = expires;
+	timerSlotAdd(timerSlotFor(expires), processId);
+	timedWaiting[processId] = TIMER_ARMED;
+}
+
+/* ticks to wait for a timeout of msec, at least one */
+static unsigned int timerTicks(int msec) {
+	unsigned int ticks = (msec + CLOCK_PERIOD - 1) / CLOCK_PERIOD;
+	return ticks == 0 ? 1 : ticks;
+}
+
+static void addTimer(int processId, int msec) {
+	/* count from the current time, not from the last clock interrupt */
+	addTimerAt(processId, nowTick() + timerTicks(msec));
+}
+
+/* disarm the timeout of processId, if any */
+static void removeTimer(int processId) {
+	if (timedWaiting[processId] == TIMER_ARMED) {
+		timerSlotRemove(processId);
+	}
+	timedWaiting[processId] = TIMER_NONE;
+}
+
+/*************** Functions for the ready queues **********/
+
+/* highest level with a ready process on core; its readyBitmap must not
+ * be 0 */
+static int highestReadyLevel(int core) {
+	return __builtin_ctz(readyBitmap[core]);
+}
+
+/* Insert a periodic process in the EDF level, after the processes with an
+ * earlier deadline and, unless first is set, after those with the same. */
+static void readyAddDeadline(int processId, int first) {
+	ProcessList* list = &readyQueues[coreOf(processId)][0];
+	unsigned int deadline = processes[processId].deadline;
+	int i = list->head;
+
+	while (i != -1) {
+		int d = (int)(processes[i].deadline - deadline);
+		if (d > 0 || (first && d == 0)) {
+			break;
+		}
+		i = processes[i].next;
+	}
+	if (i == -1) {
+		addLast(list, processId);
+	} else if (i == list->head) {
+		addFirst(list, processId);
+	} else {
+		processes[processId].prev = processes[i].prev;
+		processes[processId].next = i;
+		processes[processes[i].prev].next = processId;
+		processes[i].prev = processId;
+	}
+}
+
+/* the process core should run, -1 if only idle can run */
+static int coreHead(int core) {
+	if (readyBitmap[core] == 0) {
+		return -1;
+	}
+	return head(&readyQueues[core][highestReadyLevel(core)]);
+}
+
+/* returns the running process, -1 if only idle can run */
+static int readyHead() {
+	return coreHead(thisCore());
+}
+
+static int readyIsEmpty() {
+	return readyBitmap[thisCore()] == 0;
+}
+
+/* processId becomes ready: end of its blocked time */
+static void accountReady(int processId) {
+	ProcessDescriptor* p = &processes[processId];
+	if (p->runState != RUN_READY) {
+		unsigned int now = statsTimestamp();
+		if (p->runState == RUN_MONITOR) {
+			p->monitorCounts += now - p->stateSince;
+		}
+		p->runState = RUN_READY;
+		p->stateSince = now;
+	}
+}
+
+#ifdef SMP
+static void readyKick(int processId);
+#else
+#define readyKick(processId)
+#endif
+
+static void readyAddLast(int processId) {
+	accountReady(processId);
+	int level = processes[processId].priority + 1;
+	if (level == 0) {
+		readyAddDeadline(processId, 0);
+	} else {
+		addLast(&readyQueues[coreOf(processId)][level], processId);
+	}
+	readyBitmap[coreOf(processId)] |= 1u << level;
+	readyKick(processId);
+}
+
+static void readyAddFirst(int processId) {
+	accountReady(processId);
+	int level = processes[processId].priority + 1;
+	if (level == 0) {
+		readyAddDeadline(processId, 1);
+	} else {
+		addFirst(&readyQueues[coreOf(processId)][level], processId);
+	}
+	readyBitmap[coreOf(processId)] |= 1u << level;
+	readyKick(processId);
+}
+
+/* take a ready process out of the ready queues of its core */
+static void readyRemove(int processId) {
+	int core = coreOf(processId);
+	int level = processes[processId].priority + 1;
+	removeFromList(&readyQueues[core][level], processId);
+	if (isEmpty(&readyQueues[core][level])) {
+		readyBitmap[core] &= ~(1u << level);
+	}
+}
+
+/* remove the running process from the ready queues */
+static int readyRemoveHead() {
+	int pid = currentPid();
+	if (pid < 0) {
+		return -1;
+	}
+	readyRemove(pid);
+	/* blocked from when it is switched out, unless added back before */
+	processes[pid].runState = RUN_BLOCKED;
+	return pid;
+}
+
+#ifdef SMP
+/* interrupt core so that it chooses again what to run, unless it already
+ * has to */
+static void kick(int core) {
+	if (!kickPending[core]) {
+		kickPending[core] = 1;
+		kicks++;
+		send_ipi(core);
+	}
+}
+
+/* processId was made ready: interrupt its core if it must run there now,
+ * or else an idle core, which will take it */
+static void readyKick(int processId) {
+	int core = processes[processId].core;
+	int i;
+	if (!kernelStarted) {
+		return;
+	}
+	if (coreHead(core) == processId) {
+		if (core != thisCore() && runningPid[core] != processId) {
+			kick(core);
+		}
+		return;
+	}
+	for (i = 0; i < CORES; ++i) {
+		if (i != thisCore() && runningPid[i] == idlePids[i] && readyBitmap[i] == 0) {
+			kick(i);
+			return;
+		}
+	}
+}
+
+/* Take the first ready process of the highest level that another core has
+ * and does not run, to this core. Returns 1 if there was one. */
+static int steal() {
+	int me = thisCore();
+	int i, pid;
+	for (i = 1; i < CORES; ++i) {
+		int core = (me + i) % CORES;
+		unsigned int levels = readyBitmap[core];
+		while (levels != 0) {
+			int level = __builtin_ctz(levels);
+			levels &= levels - 1;
+			for (pid = head(&readyQueues[core][level]); pid != -1; pid = processes[pid].next) {
+				if (pid != runningPid[core] && !processes[pid].pinned) {
+					readyRemove(pid);
+					processes[pid].core = me;
+					readyAddLast(pid);
+					steals++;
+					return 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+/* whether some core has a ready process that it does not run */
+static int spareWork() {
+	int core;
+	for (core = 0; core < CORES; ++core) {
+		int pid = coreHead(core);
+		if (pid != -1 && (pid != runningPid[core] || processes[pid].next != -1
+				|| (readyBitmap[core] & (readyBitmap[core] - 1)) != 0)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+#endif
+
+/* the process this core runs next: the head of its ready queues, or a
+ * process taken from another core, or its idle process */
+static int nextToRun() {
+#ifdef SMP
+	if (readyIsEmpty() && !steal()) {
+#else
+	if (readyIsEmpty()) {
+#endif
+		return idlePids[thisCore()];
+	}
+	return readyHead();
+}
+
+/***********************************************************
+ ***********************************************************
+                    Kernel functions
+************************************************************
+* **********************************************************/
+
+/* Kernel calls run with interrupts masked, holding kernel_lock with SMP;
+ * interrupt handlers only take the lock */
+static int enterKernel() {
+	int state = saveInterrupts();
+	lockKernel();
+	return state;
+}
+
+static void leaveKernel(int state) {
+	unlockKernel();
+	restoreInterrupts(state);
+}
+
+static void clockReschedule();
+static void startIfFirst(int pid);
+static int newReadyProcess(void (*f)(), unsigned int* stack, int stackSize, int priority);
+static int newPeriodicProcess(void (*f)(), unsigned int* stack, int stackSize, int period, int budget);
+static void waitOnQueue(ConditionQueue* queue);
+static int timedWaitOnQueue(ConditionQueue* queue, int msec);
+
+/* fill a new stack with the paint, under the canary */
+static void paintStack(unsigned int* stack, int blockSize) {
+	int words = blockSize / sizeof(unsigned int);
+	int i;
+	for (i = 0; i < STACK_CANARY_WORDS; ++i) {
+		stack[i] = STACK_CANARY;
+	}
+	for (; i < words; ++i) {
+		stack[i] = STACK_PAINT;
+	}
+}
+
+/* a process whose canary was overwritten has run past the end of its
+ * stack, into the block below: stop before the damage spreads */
+static void checkStack(int pid) {
+#if STACK_CHECK
+	unsigned int* stack = processes[pid].stack;
+	int i;
+	for (i = 0; i < STACK_CANARY_WORDS; ++i) {
+		if (stack[i] != STACK_CANARY) {
+			ERRA("Stack overflow in process %d (%d bytes).", pid, processes[pid].stackBlockSize);
+			exit(1);
+		}
+	}
+#endif
+}
+
+#ifdef SMP
+/* Give back the descriptors and stacks of the exited processes. A core
+ * may still be saving one, which takes a few instructions and not the
+ * lock. */
+static void reapExited() {
+	int pid;
+	while ((pid = removeHead(&exitedProcesses)) != -1) {
+		while (transferring(processes[pid].p)) {
+			spin_wait();
 		}
-		processes[temp].next = processId;
+		if (processes[pid].stackPooled) {
+			stackRelease(processes[pid].stack);
+		}
+		processes[pid].state = PROC_FREE;
+		addFirst(&freeProcesses, pid);
+	}
+}
+
+/* first code of every process: the switch to it is over, then its function
+ * runs. The entry is read with interrupts masked, so that the core is the
+ * one the process runs on. */
+static void processStart() {
+	int state = saveInterrupts();
+	finishTransfer();
+	void (*entry)() = processes[currentPid()].entry;
+	restoreInterrupts(state);
+	entry();
+}
+#endif
+
+/* take a free descriptor and give it a stack, from the pool if stack is
+ * NULL, and an initial frame for f. Only the descriptor and the stack are
+ * taken with interrupts masked: the stack is painted with them allowed, as
+ * nothing else sees the descriptor before the caller makes it PROC_ALIVE
+ * with activateProcess. */
+static int allocProcess(void (*f)(), unsigned int* stack, int stackSize, int priority) {
+	int state = enterKernel();
+	int pid;
+#ifdef SMP
+	reapExited();
+#endif
+	if (!isEmpty(&freeProcesses)) {
+		pid = removeHead(&freeProcesses);
+	} else if (nextProcessId < MAX_PROC) {
+		pid = nextProcessId++;
+	} else {
+		ERR("Maximum number of processes reached!");
+		exit(1);
+	}
+
+	int blockSize = stackSize;
+	processes[pid].stackPooled = stack == NULL;
+	if (stack == NULL) {
+		stack = stackAlloc(stackSize, &blockSize);
+		if (stack == NULL) {
+			ERR("Could not allocate stack. Exiting...");
+			exit(1);
+		}
+	}
+#ifdef SMP
+	/* spread over the cores; idle cores even the load out later */
+	processes[pid].core = nextCore;
+	nextCore = (nextCore + 1) % CORES;
+#endif
+	leaveKernel(state);
+
+	processes[pid].stack = stack;
+	processes[pid].stackSize = stackSize;
+	processes[pid].stackBlockSize = blockSize;
+	paintStack(processes[pid].stack, blockSize);
+#ifdef SMP
+	processes[pid].entry = f;
+	processes[pid].pinned = 0;
+	f = processStart;
+#endif
+	processes[pid].p = newProcessWithExit(f, exitProcess, processes[pid].stack, blockSize);
+	processes[pid].next = -1;
+	processes[pid].prev = -1;
+	processes[pid].joiners.head = -1;
+	processes[pid].joiners.tail = -1;
+	processes[pid].currentMonitor = 0;
+	processes[pid].monitors[0] = -1;
+	int rwID;
+	for (rwID = 0; rwID < MAX_RW_MONITORS; ++rwID) {
+		processes[pid].rwShared[rwID] = 0;
+	}
+	processes[pid].timerSlot = -1;
+	processes[pid].timerList = NULL;
+	processes[pid].priority = priority;
+	processes[pid].basePriority = priority;
+	processes[pid].sliceUsed = 0;
+	processes[pid].period = 0;
+	processes[pid].runState = RUN_BLOCKED;
+	processes[pid].runCounts = 0;
+	processes[pid].readyCounts = 0;
+	processes[pid].monitorCounts = 0;
+	processes[pid].voluntarySwitches = 0;
+	processes[pid].involuntarySwitches = 0;
+	timedWaiting[pid] = TIMER_NONE;
+	return pid;
+}
+
+/* the process filled by allocProcess becomes visible to the kernel; called
+ * with interrupts masked */
+static void activateProcess(int pid) {
+	processes[pid].state = PROC_ALIVE;
+	TRACE_CREATE(pid, processes[pid].p);
+}
+
+int createProcess (void (*f)(), int stackSize) {
+	return createProcessWithPriority(f, stackSize, DEFAULT_PRIORITY);
+}
+
+int createProcessWithPriority (void (*f)(), int stackSize, int priority) {
+	return newReadyProcess(f, NULL, stackSize, priority);
+}
+
+static int newReadyProcess(void (*f)(), unsigned int* stack, int stackSize, int priority) {
+	if (priority < 0 || priority >= NUM_PRIORITIES) {
+		ERRA("Priority %d does not exist.", priority);
+		exit(1);
+	}
+	int pid = allocProcess(f, stack, stackSize, priority);
+	int state = enterKernel();
+	activateProcess(pid);
+	readyAddLast(pid);
+	startIfFirst(pid);
+	leaveKernel(state);
+	return pid;
+}
+
+#ifdef STATIC_CONFIG
+static unsigned int idleStack[CORES][SPECIAL_STACK_SIZE / sizeof(unsigned int)] __attribute__((aligned(16)));
+static int idleStacksUsed = 0;
+#endif
+
+/* the idle process, which is never in the ready queues */
+int createSpecialProcess(void (*f)()) {
+#ifdef STATIC_CONFIG
+	if (idleStacksUsed == CORES) {
+		ERR("No static stack left for an idle process.");
+		exit(1);
+	}
+	int pid = allocProcess(f, idleStack[idleStacksUsed++], SPECIAL_STACK_SIZE, NUM_PRIORITIES - 1);
+#else
+	int pid = allocProcess(f, NULL, SPECIAL_STACK_SIZE, NUM_PRIORITIES - 1);
+#endif
+	int state = enterKernel();
+	activateProcess(pid);
+	leaveKernel(state);
+	return pid;
+}
+
+/* The CPU goes from runningPid to process to: charge the time since the
+ * last switch to runningPid. Called before every switch the kernel makes,
+ * and by the processes an interrupt handler switches to when they resume.
+ * The clock interrupts are charged to the processes they interrupt. */
+static void accountSwitch(int to) {
+	int from = runningPid[thisCore()];
+	if (from == to) {
+		return;
+	}
+	unsigned int now = statsTimestamp();
+	if (from >= 0) {
+		/* the stack of an exiting process is already back in the pool */
+		if (processes[from].state == PROC_ALIVE) {
+			checkStack(from);
+		}
+		processes[from].runCounts += now - processes[from].runSince;
+		if (processes[from].runState != RUN_READY) {
+			processes[from].voluntarySwitches++;
+			/* a process that blocks gets a whole quantum when it is back */
+			processes[from].sliceUsed = 0;
+		} else {
+			processes[from].involuntarySwitches++;
+		}
+		processes[from].stateSince = now;
+	}
+	if (processes[to].runState == RUN_READY) {
+		processes[to].readyCounts += now - processes[to].stateSince;
+	}
+	processes[to].runSince = now;
+	runningPid[thisCore()] = to;
+}
+
+static void checkAndTransfer() {
+	/*if (readyIsEmpty()){
+		/*ERR("No processes in the ready list! Exiting...");
+		exit(1);
+	}*/
+	int pid = nextToRun();
+	accountSwitch(pid);
+	ctransfer(processes[pid].p);
+}
+
+/* give the CPU to a newly readied process if it has a higher priority */
+static void preemptIfNeeded(int myID) {
+	if (readyHead() != myID) {
+		checkAndTransfer();
+	}
+}
+
+/* same, from an interrupt handler that readied a process: switch if the
+ * interrupted process is no longer the one that should run */
+static void preemptFromISR() {
+	int pid = nextToRun();
+	if (processes[pid].p != running) {
+		clockReschedule();
+		accountSwitch(pid);
+		transfer(processes[pid].p);
+	}
+}
+
+/* a process created by a running process, once the kernel has started,
+ * runs at once if it comes first in the ready queues */
+static void startIfFirst(int pid) {
+	if (runningPid[thisCore()] < 0) {
+		return;
+	}
+	clockReschedule();
+	if (readyHead() == pid) {
+		checkAndTransfer();
+	}
+}
+
+
+/*************** Periodic processes **********/
+
+int createPeriodicProcess(void (*f)(), int stackSize, int period, int budget) {
+	return newPeriodicProcess(f, NULL, stackSize, period, budget);
+}
+
+static int newPeriodicProcess(void (*f)(), unsigned int* stack, int stackSize, int period, int budget) {
+	if (period <= 0 || budget <= 0 || budget > period) {
+		ERRA("Invalid period %d or budget %d.", period, budget);
+		exit(1);
+	}
+	/* rounded up, so that rounding never admits an infeasible set */
+	unsigned int utilization = ((unsigned long long)budget * EDF_UTILIZATION_ONE + period - 1) / period;
+
+	int state = enterKernel();
+	if ((unsigned long long)(edfUtilization + utilization) * 100
+			> (unsigned long long)EDF_MAX_UTILIZATION * EDF_UTILIZATION_ONE) {
+		leaveKernel(state);
+		return -1;
+	}
+	edfUtilization += utilization;
+	leaveKernel(state);
+
+	int pid = allocProcess(f, stack, stackSize, EDF_PRIORITY);
+	processes[pid].period = timerTicks(period);
+	processes[pid].utilization = utilization;
+	processes[pid].deadlineMisses = 0;
+
+	state = enterKernel();
+	processes[pid].release = nowTick();
+	processes[pid].deadline = processes[pid].release + processes[pid].period;
+	activateProcess(pid);
+	readyAddLast(pid);
+	startIfFirst(pid);
+	leaveKernel(state);
+	return pid;
+}
+
+void waitNextPeriod() {
+	int state = enterKernel();
+
+	int myID = currentPid();
+	ProcessDescriptor* me = &processes[myID];
+
+	if (me->period == 0) {
+		ERRA("Process %d is not periodic.", myID);
+		exit(1);
+	}
+
+	unsigned int now = nowTick();
+	if ((int)(now - me->deadline) > 0) {
+		me->deadlineMisses++;
+	}
+
+	/* the next job is released one period after this one, however late
+	 * this one completes, so that releases do not drift */
+	me->release += me->period;
+	me->deadline = me->release + me->period;
+
+	readyRemoveHead();
+	if ((int)(me->release - now) > 0) {
+		addTimerAt(myID, me->release);
+		me->timerMonitor = -1;
+		clockReschedule();
+	} else {
+		/* late: the next job is already released */
+		readyAddLast(myID);
+	}
+	checkAndTransfer();
+
+	leaveKernel(state);
+}
+
+int getDeadlineMisses(int pid) {
+	if (pid < 0 || pid >= nextProcessId || processes[pid].state != PROC_ALIVE
+			|| processes[pid].period == 0) {
+		ERRA("Process %d is not an alive periodic process.", pid);
+		exit(1);
+	}
+	return processes[pid].deadlineMisses;
+}
+
+void exitProcess() {
+	maskInterrupts();
+	lockKernel();
+
+	int myID = currentPid();
+
+	if (processes[myID].currentMonitor > 0) {
+		ERRA("Process %d exited inside a monitor.", myID);
+		exit(1);
+	}
+
+	readyRemoveHead();
+	removeTimer(myID);
+	if (processes[myID].period != 0) {
+		edfUtilization -= processes[myID].utilization;
+	}
+
+	/* wake up the processes joining this one */
+	while (!isEmpty(&processes[myID].joiners)) {
+		readyAddLast(removeHead(&processes[myID].joiners));
+	}
+
+#ifdef SMP
+	/* another core may allocate as soon as the switch gives up the lock,
+	 * while we are still on the stack: reapExited frees it */
+	processes[myID].state = PROC_EXITED;
+	addLast(&exitedProcesses, myID);
+#else
+	/* we are still running on the stack, but nothing can reuse it before
+	 * we switch away with interrupts masked */
+	if (processes[myID].stackPooled) {
+		stackRelease(processes[myID].stack);
+	}
+	processes[myID].state = PROC_FREE;
+	addFirst(&freeProcesses, myID);
+#endif
+
+	checkAndTransfer();
+}
+
+void joinProcess(int pid) {
+	int state = enterKernel();
+
+	int myID = currentPid();
+
+	if (pid < 0 || pid >= nextProcessId) {
+		ERRA("Process %d does not exist.", pid);
+		exit(1);
+	}
+	if (pid == myID) {
+		ERR("A process cannot join itself.");
+		exit(1);
+	}
+
+	if (processes[pid].state == PROC_ALIVE) {
+		readyRemoveHead();
+		addLast(&processes[pid].joiners, myID);
+		checkAndTransfer();
+	}
+
+	leaveKernel(state);
+}
+
+void yield(){
+	int state = enterKernel();
+	/* go to the back of the queue of my priority level */
+	int pid = readyRemoveHead();
+	readyAddLast(pid);
+	checkAndTransfer();
+	leaveKernel(state);
+}
+
+unsigned int getSwitchCount() {
+	return switchCount;
+}
+
+/* whether pid has a core */
+static int isRunning(int pid) {
+	int core;
+	for (core = 0; core < CORES; ++core) {
+		if (runningPid[core] == pid) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int isIdle(int pid) {
+	int core;
+	for (core = 0; core < CORES; ++core) {
+		if (idlePids[core] == pid) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* timer counts to microseconds; the timer runs at a whole number of MHz */
+static unsigned long long countsToMicroseconds(unsigned long long counts) {
+	return counts / (TIMER_FREQ / 1000000);
+}
+
+int getProcessStats(int pid, ProcessStats* stats) {
+	int state = enterKernel();
+	if (pid < 0 || pid >= nextProcessId || processes[pid].state != PROC_ALIVE) {
+		leaveKernel(state);
+		return 0;
+	}
+	ProcessDescriptor* p = &processes[pid];
+	unsigned int now = statsTimestamp();
+	unsigned long long run = p->runCounts;
+	unsigned long long ready = p->readyCounts;
+	unsigned long long monitor = p->monitorCounts;
+	/* include the current period */
+	if (isRunning(pid)) {
+		run += now - p->runSince;
+	} else if (p->runState == RUN_READY) {
+		ready += now - p->stateSince;
+	} else if (p->runState == RUN_MONITOR) {
+		monitor += now - p->stateSince;
+	}
+	stats->runTime = countsToMicroseconds(run);
+	stats->readyTime = countsToMicroseconds(ready);
+	stats->monitorTime = countsToMicroseconds(monitor);
+	stats->voluntarySwitches = p->voluntarySwitches;
+	stats->involuntarySwitches = p->involuntarySwitches;
+	stats->priority = p->priority;
+#ifdef SMP
+	stats->core = p->core;
+#else
+	stats->core = 0;
+#endif
+	leaveKernel(state);
+	return 1;
+}
+
+void getKernelStats(KernelStats* stats) {
+	ProcessStats special;
+	int i, core;
+
+	int state = enterKernel();
+	stats->uptime = (unsigned long long)clock_now() * CLOCK_PERIOD * 1000;
+	stats->switches = switchCount;
+	stats->clockInterrupts = clockInterrupts;
+	stats->processes = nextProcessId;
+	stats->idlePid = idlePids[0];
+	stats->cores = CORES;
+#ifdef SMP
+	stats->steals = steals;
+	stats->kicks = kicks;
+#else
+	stats->steals = 0;
+	stats->kicks = 0;
+#endif
+	stats->tickTime = countsToMicroseconds(tickCounts);
+	stats->preemptions = 0;
+	for (i = 0; i < nextProcessId; ++i) {
+		if (processes[i].state == PROC_ALIVE) {
+			stats->preemptions += processes[i].involuntarySwitches;
+		}
+	}
+	leaveKernel(state);
+
+	stats->idleTime = 0;
+	for (core = 0; core < CORES; ++core) {
+		if (getProcessStats(idlePids[core], &special)) {
+			stats->idleTime += special.runTime;
+		}
+	}
+}
+
+/* the paint is only overwritten from the top of the stack down, so the
+ * lowest word changed marks the deepest use. The scan only reads, so it
+ * is made with interrupts allowed; the figure is meaningless for a process
+ * that exits meanwhile. */
+int stackHighWater(int pid) {
+	int state = enterKernel();
+	if (pid < 0 || pid >= nextProcessId || processes[pid].state != PROC_ALIVE) {
+		leaveKernel(state);
+		return -1;
+	}
+	unsigned int* stack = processes[pid].stack;
+	int words = processes[pid].stackBlockSize / sizeof(unsigned int);
+	leaveKernel(state);
+
+	int i = STACK_CANARY_WORDS;
+	while (i < words && stack[i] == STACK_PAINT) {
+		++i;
+	}
+	return (words - i) * sizeof(unsigned int);
+}
+
+void stackReport() {
+	int pid;
+	int asked = 0, reserved = 0, recommended = 0;
+	printf("  PID      asked      block       used  recommended\n");
+	for (pid = 0; pid < nextProcessId; ++pid) {
+		int used = stackHighWater(pid);
+		if (used < 0) {
+			continue;
+		}
+		/* the deepest use seen so far may miss a rare path or a nested
+		 * interrupt: keep a margin */
+		int size = (used + used / 4 + STACK_REPORT_MARGIN + 15) & ~15;
+		if (size > processes[pid].stackBlockSize) {
+			size = processes[pid].stackBlockSize;
+		}
+		printf("%5d %10d %10d %10d %12d%s\n", pid, processes[pid].stackSize,
+				processes[pid].stackBlockSize, used, size,
+				isIdle(pid) ? "  idle" : "");
+		asked += processes[pid].stackSize;
+		reserved += processes[pid].stackBlockSize;
+		recommended += size;
+	}
+	printf("total %10d %10d %10s %12d\n", asked, reserved, "", recommended);
+}
+
+int createMonitor(){
+	int state = enterKernel();
+	if (nextMonitorId == MAX_MONITORS){
+		ERR("Maximum number of monitors reached!\n");
+		exit(1);
+	}
+	monitors[nextMonitorId].timesTaken = 0;
+	monitors[nextMonitorId].takenBy = -1;
+	monitors[nextMonitorId].entryList.head = -1;
+	monitors[nextMonitorId].entryList.tail = -1;
+	monitors[nextMonitorId].notifiedList.head = -1;
+	monitors[nextMonitorId].notifiedList.tail = -1;
+	monitors[nextMonitorId].condition.waitingList.head = -1;
+	monitors[nextMonitorId].condition.waitingList.tail = -1;
+	monitors[nextMonitorId].condition.notifyAllEpoch = 0;
+	int mid = nextMonitorId;
+	nextMonitorId++;
+	leaveKernel(state);
+	return mid;
+}
+
+/*
+ * With MONITOR_HANDOFF, a process let into a monitor is put at the head of
+ * its ready queue, so it runs as soon as the process leaving the monitor
+ * gives up the CPU (at once in exitMonitor, when its priority is not lower)
+ * instead of after a round of the ready queue. Processes moved out of a
+ * condition by notify go to notifiedList, ahead of the entryList, so
+ * that the condition they were notified of still holds when they get in.
+ */
+#ifdef MONITOR_HANDOFF
+#define readyAddEntrant(pid)	readyAddFirst(pid)
+#define NOTIFIED_LIST(mon)		(monitors[mon].notifiedList)
+#else
+#define readyAddEntrant(pid)	readyAddLast(pid)
+#define NOTIFIED_LIST(mon)		(monitors[mon].entryList)
+#endif
+
+/* the monitor is left by its owner: let the next process in, if any */
+static void passMonitor(int monitorID) {
+	int pid;
+
+	if (!isEmpty(&monitors[monitorID].notifiedList)) {
+		pid = removeHead(&monitors[monitorID].notifiedList);
+	} else if (!isEmpty(&monitors[monitorID].entryList)) {
+		pid = removeHead(&monitors[monitorID].entryList);
+	} else {
+		monitors[monitorID].timesTaken = 0;
+		monitors[monitorID].takenBy = -1;
+		return;
+	}
+	readyAddEntrant(pid);
+	monitors[monitorID].timesTaken = 1;
+	monitors[monitorID].takenBy = pid;
+}
+
+static int getCurrentMonitor(int pid) {
+	int result = processes[pid].monitors[processes[pid].currentMonitor];
+	return result;
+}
+
+void enterMonitor(int monitorID) {
+	int state = enterKernel();
+
+	int myID = currentPid();
+
+	if (monitorID > nextMonitorId || monitorID < 0) {
+		ERRA("Monitor %d does not exist.", nextMonitorId);
+		exit(1);
+	}
+
+	if (processes[myID].currentMonitor >= MAX_MONITORS) {
+		ERR("Too many nested calls.");
+		exit(1);
+	}
+
+	if (monitors[monitorID].timesTaken > 0 && monitors[monitorID].takenBy != myID) {
+		TRACE_MONITOR(TRACE_EV_MON_BLOCK, monitorID, myID);
+		readyRemoveHead();
+		processes[myID].runState = RUN_MONITOR;
+		addLast(&(monitors[monitorID].entryList), myID);
+		checkAndTransfer();
+
+		/* I am woken up by exitMonitor -- check if the monitor state is consistent */
+		if ((monitors[monitorID].timesTaken != 1) || (monitors[monitorID].takenBy != myID)) {
+			ERR("The kernel has performed an illegal operation. Please contact customer support.");
+			exit(1);
+		}
+	}
+	else {
+		monitors[monitorID].timesTaken++;
+		monitors[monitorID].takenBy = myID;
+	}
+
+	/* push the new call onto the call stack */
+	processes[myID].monitors[++processes[myID].currentMonitor] = monitorID;
+	TRACE_MONITOR(TRACE_EV_MON_ENTER, monitorID, myID);
+
+	leaveKernel(state);
+}
+
+void exitMonitor() {
+	int state = enterKernel();
+
+	int myID = currentPid();
+	int myMonitor = getCurrentMonitor(myID);
+
+	if (myMonitor < 0) {
+		ERRA("Process %d called exitMonitor outside of a monitor.", myID);
+		exit(1);
+	}
+
+	/* go backwards in the stack of called monitors */
+	processes[myID].currentMonitor--;
+	TRACE_MONITOR(TRACE_EV_MON_EXIT, myMonitor, myID);
+
+	if (--monitors[myMonitor].timesTaken == 0) {
+		passMonitor(myMonitor);
+	}
+
+	clockReschedule();
+	preemptIfNeeded(myID);
+
+	leaveKernel(state);
+}
+
+/* move the first waiter of queue to the entry list of monitor */
+static void notifyQueue(ConditionQueue* queue, int monitor) {
+	TRACE_MONITOR(TRACE_EV_MON_NOTIFY, monitor, currentPid());
+	if (!isEmpty(&queue->waitingList)) {
+		int pid = removeHead(&queue->waitingList);
+		removeTimer(pid);
+		addLast(&NOTIFIED_LIST(monitor), pid);
+	}
+}
+
+/* Move the whole waiting list at once. Pending timeouts of the moved
+ * processes are not walked: bumping the epoch marks them as stale, and
+ * they are disarmed by timedWait or ignored when they fire. */
+static void notifyAllQueue(ConditionQueue* queue, int monitor) {
+	TRACE_MONITOR(TRACE_EV_MON_NOTIFY_ALL, monitor, currentPid());
+	if (!isEmpty(&queue->waitingList)) {
+		appendList(&NOTIFIED_LIST(monitor), &queue->waitingList);
+		queue->notifyAllEpoch++;
+	}
+}
+
+void notify() {
+	int state = enterKernel();
+
+	int myID = currentPid();
+	int myMonitor = getCurrentMonitor(myID);
+
+	if (myMonitor < 0) {
+		ERRA("Process %d called notify outside of a monitor.", myID);
+		exit(1);
+	}
+
+	notifyQueue(&monitors[myMonitor].condition, myMonitor);
+
+	leaveKernel(state);
+}
+
+void notifyAll() {
+	int state = enterKernel();
+
+	int myID = currentPid();
+	int myMonitor = getCurrentMonitor(myID);
+
+	if (myMonitor < 0) {
+		ERRA("Process %d called notify outside of a monitor.", myID);
+		exit(1);
+	}
+
+	notifyAllQueue(&monitors[myMonitor].condition, myMonitor);
+
+	leaveKernel(state);
+}
+
+/*************** Conditions **********/
+
+int createCondition(int monitorID) {
+	int state = enterKernel();
+	if (nextConditionId == MAX_CONDITIONS){
+		ERR("Maximum number of conditions reached!\n");
+		exit(1);
+	}
+	if (monitorID >= nextMonitorId || monitorID < 0) {
+		ERRA("Monitor %d does not exist.", monitorID);
+		exit(1);
+	}
+	conditions[nextConditionId].monitor = monitorID;
+	conditions[nextConditionId].queue.waitingList.head = -1;
+	conditions[nextConditionId].queue.waitingList.tail = -1;
+	conditions[nextConditionId].queue.notifyAllEpoch = 0;
+	int cid = nextConditionId;
+	nextConditionId++;
+	leaveKernel(state);
+	return cid;
+}
+
+/* the caller must be in the monitor of the condition, innermost */
+static ConditionDescriptor* getCondition(int conditionID) {
+	int myID = currentPid();
+
+	if (conditionID >= nextConditionId || conditionID < 0) {
+		ERRA("Condition %d does not exist.", conditionID);
+		exit(1);
+	}
+	if (getCurrentMonitor(myID) != conditions[conditionID].monitor) {
+		ERRA("Process %d used a condition outside of its monitor.", myID);
+		exit(1);
+	}
+	return &conditions[conditionID];
+}
+
+void waitOn(int conditionID) {
+	int state = enterKernel();
+	waitOnQueue(&getCondition(conditionID)->queue);
+	leaveKernel(state);
+}
+
+int timedWaitOn(int conditionID, int msec) {
+	int state = enterKernel();
+	int result = timedWaitOnQueue(&getCondition(conditionID)->queue, msec);
+	leaveKernel(state);
+	return result;
+}
+
+void signalCondition(int conditionID) {
+	int state = enterKernel();
+	ConditionDescriptor* condition = getCondition(conditionID);
+	notifyQueue(&condition->queue, condition->monitor);
+	leaveKernel(state);
+}
+
+void broadcastCondition(int conditionID) {
+	int state = enterKernel();
+	ConditionDescriptor* condition = getCondition(conditionID);
+	notifyAllQueue(&condition->queue, condition->monitor);
+	leaveKernel(state);
+}
+
+/*************** Blocking on a kernel object **********/
+
+/* block the caller on list until wakeFirst, or, if timed, until the
+ * absolute tick expires; returns 0 on timeout */
+static int blockOn(ProcessList* list, int timed, unsigned int expires) {
+	int myID = currentPid();
+
+	if (timed) {
+		if ((int)(expires - nowTick()) <= 0) {
+			return 0;
+		}
+		addTimerAt(myID, expires);
+		processes[myID].timerMonitor = -1;
+		processes[myID].timerList = list;
+	}
+
+	readyRemoveHead();
+	addLast(list, myID);
+	clockReschedule();
+	checkAndTransfer();
+
+	if (timed) {
+		processes[myID].timerList = NULL;
+		if (timedWaiting[myID] == TIMER_EXPIRED) {
+			timedWaiting[myID] = TIMER_NONE;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* make the first process blocked on list ready; what it waited for is
+ * handed over by the caller, so it does not have to check again */
+static void wakeFirst(ProcessList* list) {
+	if (!isEmpty(list)) {
+		int pid = removeHead(list);
+		removeTimer(pid);
+		readyAddLast(pid);
+	}
+}
+
+/*************** Semaphores **********/
+
+int createSemaphore(int initial) {
+	int state = enterKernel();
+	if (nextSemaphoreId == MAX_SEMAPHORES){
+		ERR("Maximum number of semaphores reached!\n");
+		exit(1);
+	}
+	if (initial < 0) {
+		ERRA("Invalid semaphore count %d.", initial);
+		exit(1);
+	}
+	semaphores[nextSemaphoreId].count = initial;
+	semaphores[nextSemaphoreId].waiters.head = -1;
+	semaphores[nextSemaphoreId].waiters.tail = -1;
+	int sid = nextSemaphoreId;
+	nextSemaphoreId++;
+	leaveKernel(state);
+	return sid;
+}
+
+static SemaphoreDescriptor* getSemaphore(int semaphoreID) {
+	if (semaphoreID >= nextSemaphoreId || semaphoreID < 0) {
+		ERRA("Semaphore %d does not exist.", semaphoreID);
+		exit(1);
+	}
+	return &semaphores[semaphoreID];
+}
+
+/* take a unit, or block until semaphorePost hands one over */
+static int semaphoreTake(int semaphoreID, int timed, unsigned int expires) {
+	SemaphoreDescriptor* sem = getSemaphore(semaphoreID);
+	if (sem->count > 0) {
+		sem->count--;
+		return 1;
 	}
-	processes[processId].next = -1;
+	return blockOn(&sem->waiters, timed, expires);
 }
 
-/* add element to the head of list */
-static void addFirst(int* list, int processId){
-	processes[processId].next = *list;
-	*list = processId;
+void semaphoreWait(int semaphoreID) {
+	int state = enterKernel();
+	semaphoreTake(semaphoreID, 0, 0);
+	leaveKernel(state);
 }
 
-int size(int* list) {
-	int i;
-	for (i=0 ; *list != -1 ; i++) {
-		list = &processes[*list].next;
+int semaphoreTimedWait(int semaphoreID, int msec) {
+	int state = enterKernel();
+	if(msec < 0) {
+		ERR("[semaphoreTimedWait] Please provide a valid timeout");
+		exit(1);
 	}
+	int taken = semaphoreTake(semaphoreID, 1, nowTick() + timerTicks(msec));
+	leaveKernel(state);
+	return taken;
+}
 
-	return i;
+/* give a unit to the first waiter, if any; returns 1 if one was woken */
+static int semaphoreGive(int semaphoreID) {
+	SemaphoreDescriptor* sem = getSemaphore(semaphoreID);
+	if (isEmpty(&sem->waiters)) {
+		sem->count++;
+		return 0;
+	}
+	wakeFirst(&sem->waiters);
+	return 1;
 }
 
-/* remove an element from the head of the list */
-static int removeHead(int* list){
-	if (*list == -1){
-		return(-1);
+void semaphorePost(int semaphoreID) {
+	int state = enterKernel();
+	int myID = currentPid();
+	if (semaphoreGive(semaphoreID)) {
+		clockReschedule();
+		preemptIfNeeded(myID);
 	}
-	else {
-		int head = *list;
-		int next = processes[*list].next;
-		processes[*list].next = -1;
-		*list = next;
-		return head;
+	leaveKernel(state);
+}
+
+void semaphorePostFromISR(int semaphoreID) {
+	lockKernel();
+	if (semaphoreGive(semaphoreID)) {
+		/* the process woken may share the priority of the interrupted
+		 * one, and then needs its time slice armed without a switch */
+		clockReschedule();
+		preemptFromISR();
 	}
+	unlockKernel();
 }
 
-static void removeFromList(int* list, int processId) {
-	int i;
+/*************** Reader-writer monitors **********/
 
-	for (i=0 ; *list != -1 ; i++) {
-		if (*list == processId) {
-			*list = processes[processId].next;
-			processes[processId].next = -1;
-			break;
-		}
-		list = &processes[*list].next;
+int createRWMonitor(int policy) {
+	int state = enterKernel();
+	if (nextRWMonitorId == MAX_RW_MONITORS){
+		ERR("Maximum number of reader-writer monitors reached!\n");
+		exit(1);
+	}
+	if (policy != RW_WRITER_PREFERRING && policy != RW_FIFO) {
+		ERRA("Invalid reader-writer policy %d.", policy);
+		exit(1);
 	}
+	RWMonitorDescriptor* rw = &rwMonitors[nextRWMonitorId];
+	rw->policy = policy;
+	rw->readers = 0;
+	rw->writer = -1;
+	rw->readWaiters.head = -1;
+	rw->readWaiters.tail = -1;
+	rw->writeWaiters.head = -1;
+	rw->writeWaiters.tail = -1;
+	rw->nextTicket = 0;
+	int id = nextRWMonitorId;
+	nextRWMonitorId++;
+	leaveKernel(state);
+	return id;
 }
 
-/* returns the head of the list */
-static int head(int* list){
-	return *list;
+static RWMonitorDescriptor* getRWMonitor(int rwID) {
+	if (rwID >= nextRWMonitorId || rwID < 0) {
+		ERRA("Reader-writer monitor %d does not exist.", rwID);
+		exit(1);
+	}
+	return &rwMonitors[rwID];
 }
 
-/* checks if the list is empty */
-static int isEmpty(int* list) {
-	return *list < 0;
+/* queue the running process until the monitor is handed over to it */
+static void rwBlock(RWMonitorDescriptor* rw, ProcessList* list) {
+	int myID = readyRemoveHead();
+	processes[myID].runState = RUN_MONITOR;
+	processes[myID].rwTicket = rw->nextTicket++;
+	addLast(list, myID);
+	clockReschedule();
+	checkAndTransfer();
 }
 
-/***********************************************************
- ***********************************************************
-                    Kernel functions
-************************************************************
-* **********************************************************/
+/* ticket of the first process of list, compared with the others */
+static int rwFirstBefore(ProcessList* list, ProcessList* other) {
+	return !isEmpty(list) && (isEmpty(other)
+			|| (int)(processes[list->head].rwTicket - processes[other->head].rwTicket) < 0);
+}
 
-void createProcess (void (*f)(), int stackSize) {
-	if (nextProcessId == MAX_PROC){
-		ERR("Maximum number of processes reached!");
+/* The monitor is free: let in the next writer, or every reader queued
+ * before it (all of them if writers are preferred) in one pass. The
+ * processes let in own the monitor when they resume. Returns 1 if any. */
+static int rwAdmit(RWMonitorDescriptor* rw) {
+	int writerFirst = rw->policy == RW_WRITER_PREFERRING
+			? !isEmpty(&rw->writeWaiters)
+			: rwFirstBefore(&rw->writeWaiters, &rw->readWaiters);
+	if (writerFirst) {
+		rw->writer = removeHead(&rw->writeWaiters);
+		readyAddLast(rw->writer);
+		return 1;
+	}
+	if (isEmpty(&rw->readWaiters)) {
+		return 0;
+	}
+	do {
+		rw->readers++;
+		readyAddLast(removeHead(&rw->readWaiters));
+	} while (rw->policy == RW_WRITER_PREFERRING
+			? !isEmpty(&rw->readWaiters)
+			: rwFirstBefore(&rw->readWaiters, &rw->writeWaiters));
+	return 1;
+}
+
+void enterShared(int rwID) {
+	int state = enterKernel();
+	RWMonitorDescriptor* rw = getRWMonitor(rwID);
+	int myID = currentPid();
+	/* the cases that would wait for the caller itself to leave */
+	if (rw->writer == myID) {
+		ERRA("Process %d entered reader-writer monitor %d in shared mode while inside in exclusive mode.", myID, rwID);
 		exit(1);
 	}
-	unsigned int* stack = malloc(stackSize);
-	if (stack==NULL) {
-		ERR("Could not allocate stack. Exiting...");
+	if (processes[myID].rwShared[rwID] > 0 && !isEmpty(&rw->writeWaiters)) {
+		ERRA("Process %d entered reader-writer monitor %d in shared mode again while a writer waits.", myID, rwID);
 		exit(1);
 	}
-	processes[nextProcessId].p = newProcess(f, stack, stackSize);
-	processes[nextProcessId].next = -1;
-	processes[nextProcessId].currentMonitor = 0;
-	processes[nextProcessId].monitors[0] = -1;
-	processes[nextProcessId].timeout = -1;
-
-	addLast(&readyList, nextProcessId);
-	nextProcessId++;
+	if (processes[myID].rwShared[rwID] == UCHAR_MAX) {
+		ERRA("Process %d entered reader-writer monitor %d in shared mode too many times.", myID, rwID);
+		exit(1);
+	}
+	/* readers do not overtake a waiting writer, under either policy */
+	if (rw->writer == -1 && isEmpty(&rw->writeWaiters)) {
+		rw->readers++;
+	} else {
+		rwBlock(rw, &rw->readWaiters);
+	}
+	processes[myID].rwShared[rwID]++;
+	leaveKernel(state);
 }
 
-int createSpecialProcess(void (*f)()) {
-
-	if (nextProcessId == MAX_PROC){
-		ERR("Maximum number of processes reached!");
+void enterExclusive(int rwID) {
+	int state = enterKernel();
+	RWMonitorDescriptor* rw = getRWMonitor(rwID);
+	int myID = currentPid();
+	if (rw->writer == myID) {
+		ERRA("Process %d entered reader-writer monitor %d twice.", myID, rwID);
 		exit(1);
 	}
-
-	unsigned int* stack = malloc(STACK_SIZE);
-	if (stack==NULL) {
-		ERR("Could not allocate stack. Exiting...");
+	if (processes[myID].rwShared[rwID] > 0) {
+		ERRA("Process %d entered reader-writer monitor %d in exclusive mode while inside in shared mode.", myID, rwID);
 		exit(1);
 	}
-	processes[nextProcessId].p = newProcess(f, stack, STACK_SIZE);
-	processes[nextProcessId].next = -1;
-	processes[nextProcessId].currentMonitor = 0;
-	processes[nextProcessId].monitors[0] = -1;
-	processes[nextProcessId].timeout = -1;
-
-	int pid = nextProcessId;
-	nextProcessId++;
-	return pid;
+	if (rw->writer == -1 && rw->readers == 0) {
+		rw->writer = myID;
+	} else {
+		rwBlock(rw, &rw->writeWaiters);
+	}
+	leaveKernel(state);
 }
 
-static void checkAndTransfer() {
-	/*if (isEmpty(&readyList)){
-		/*ERR("No processes in the ready list! Exiting...");
+void exitRW(int rwID) {
+	int state = enterKernel();
+	RWMonitorDescriptor* rw = getRWMonitor(rwID);
+	int myID = currentPid();
+	if (rw->writer == myID) {
+		rw->writer = -1;
+	} else if (processes[myID].rwShared[rwID] > 0) {
+		processes[myID].rwShared[rwID]--;
+		rw->readers--;
+	} else {
+		ERRA("Process %d called exitRW outside of reader-writer monitor %d.", myID, rwID);
 		exit(1);
-	}*/
-	int pid = isEmpty(&readyList) ? idle_pid : head(&readyList);
-	transfer(processes[pid].p);
+	}
+	if (rw->readers == 0 && rwAdmit(rw)) {
+		clockReschedule();
+		preemptIfNeeded(myID);
+	}
+	leaveKernel(state);
 }
 
+/*************** Event flag groups **********/
 
-
-void yield(){
-	maskInterrupts();
-	int pid = isEmpty(&readyList) ? idle_pid : removeHead(&readyList);
-	addLast(&readyList, pid);
-	checkAndTransfer();
-	allowInterrupts();
+int createEventFlags() {
+	int state = enterKernel();
+	if (nextEventFlagsId == MAX_EVENT_FLAGS){
+		ERR("Maximum number of event flag groups reached!\n");
+		exit(1);
+	}
+	eventFlags[nextEventFlagsId].flags = 0;
+	eventFlags[nextEventFlagsId].waiters.head = -1;
+	eventFlags[nextEventFlagsId].waiters.tail = -1;
+	int fid = nextEventFlagsId;
+	nextEventFlagsId++;
+	leaveKernel(state);
+	return fid;
 }
 
-int createMonitor(){
-	maskInterrupts();
-	if (nextMonitorId == MAX_MONITORS){
-		ERR("Maximum number of monitors reached!\n");
+static EventFlagsDescriptor* getEventFlags(int groupID) {
+	if (groupID >= nextEventFlagsId || groupID < 0) {
+		ERRA("Event flag group %d does not exist.", groupID);
 		exit(1);
 	}
-	monitors[nextMonitorId].timesTaken = 0;
-	monitors[nextMonitorId].takenBy = -1;
-	monitors[nextMonitorId].entryList = -1;
-	monitors[nextMonitorId].waitingList = -1;
-	int mid = nextMonitorId;
-	nextMonitorId++;
-	allowInterrupts();
-	return mid;
+	return &eventFlags[groupID];
 }
 
-static int getCurrentMonitor(int pid) {
-	int result = processes[pid].monitors[processes[pid].currentMonitor];
-	return result;
+/* if flags satisfy a wait for wanted with options mode, consume them as
+ * asked and return the bits that matched; 0 otherwise */
+static unsigned int flagsMatch(EventFlagsDescriptor* group, unsigned int wanted, int mode) {
+	unsigned int matched = group->flags & wanted;
+	if (matched == 0 || ((mode & EVENT_FLAGS_ALL) && matched != wanted)) {
+		return 0;
+	}
+	if (mode & EVENT_FLAGS_CLEAR) {
+		group->flags &= ~matched;
+	}
+	return matched;
 }
 
-void enterMonitor(int monitorID) {
-	maskInterrupts();
-
-	int myID = head(&readyList);
+static unsigned int eventFlagsTake(int groupID, unsigned int wanted, int mode,
+		int timed, unsigned int expires) {
+	EventFlagsDescriptor* group = getEventFlags(groupID);
+	int myID = currentPid();
 
-	if (monitorID > nextMonitorId || monitorID < 0) {
-		ERRA("Monitor %d does not exist.", nextMonitorId);
+	if (wanted == 0) {
+		ERR("Waiting for no event flag.");
 		exit(1);
 	}
+	unsigned int matched = flagsMatch(group, wanted, mode);
+	if (matched != 0) {
+		return matched;
+	}
+	processes[myID].flagsWanted = wanted;
+	processes[myID].flagsMode = mode;
+	if (!blockOn(&group->waiters, timed, expires)) {
+		return 0;
+	}
+	return processes[myID].flagsGot;
+}
 
-	if (processes[myID].currentMonitor >= MAX_MONITORS) {
-		ERR("Too many nested calls.");
+unsigned int waitEventFlags(int groupID, unsigned int flags, int mode) {
+	int state = enterKernel();
+	unsigned int matched = eventFlagsTake(groupID, flags, mode, 0, 0);
+	leaveKernel(state);
+	return matched;
+}
+
+unsigned int timedWaitEventFlags(int groupID, unsigned int flags, int mode, int msec) {
+	int state = enterKernel();
+	if(msec < 0) {
+		ERR("[timedWaitEventFlags] Please provide a valid timeout");
 		exit(1);
 	}
+	unsigned int matched = eventFlagsTake(groupID, flags, mode, 1, nowTick() + timerTicks(msec));
+	leaveKernel(state);
+	return matched;
+}
 
-	if (monitors[monitorID].timesTaken > 0 && monitors[monitorID].takenBy != myID) {
-		removeHead(&readyList);
-		addLast(&(monitors[monitorID].entryList), myID);
-		checkAndTransfer();
-
-		/* I am woken up by exitMonitor -- check if the monitor state is consistent */
-		if ((monitors[monitorID].timesTaken != 1) || (monitors[monitorID].takenBy != myID)) {
-			ERR("The kernel has performed an illegal operation. Please contact customer support.");
-			exit(1);
+/* set flags and wake, in order, every waiter they satisfy; returns the
+ * number of processes woken */
+static int eventFlagsGive(int groupID, unsigned int flags) {
+	EventFlagsDescriptor* group = getEventFlags(groupID);
+	int woken = 0;
+	int pid = group->waiters.head;
+
+	group->flags |= flags;
+	while (pid != -1 && group->flags != 0) {
+		int next = processes[pid].next;
+		unsigned int matched = flagsMatch(group, processes[pid].flagsWanted,
+				processes[pid].flagsMode);
+		if (matched != 0) {
+			processes[pid].flagsGot = matched;
+			removeFromList(&group->waiters, pid);
+			removeTimer(pid);
+			readyAddLast(pid);
+			woken++;
 		}
+		pid = next;
 	}
-	else {
-		monitors[monitorID].timesTaken++;
-		monitors[monitorID].takenBy = myID;
+	return woken;
+}
+
+void setEventFlags(int groupID, unsigned int flags) {
+	int state = enterKernel();
+	int myID = currentPid();
+	if (eventFlagsGive(groupID, flags)) {
+		clockReschedule();
+		preemptIfNeeded(myID);
 	}
+	leaveKernel(state);
+}
 
-	/* push the new call onto the call stack */
-	processes[myID].monitors[++processes[myID].currentMonitor] = monitorID;
+void setEventFlagsFromISR(int groupID, unsigned int flags) {
+	lockKernel();
+	if (eventFlagsGive(groupID, flags)) {
+		clockReschedule();
+		preemptFromISR();
+	}
+	unlockKernel();
+}
 
-	allowInterrupts();
+void clearEventFlags(int groupID, unsigned int flags) {
+	int state = enterKernel();
+	getEventFlags(groupID)->flags &= ~flags;
+	leaveKernel(state);
 }
 
-void exitMonitor() {
-	maskInterrupts();
+unsigned int getEventFlagsValue(int groupID) {
+	return getEventFlags(groupID)->flags;
+}
 
-	int myID = head(&readyList);
-	int myMonitor = getCurrentMonitor(myID);
+/*************** Mailboxes **********/
 
-	if (myMonitor < 0) {
-		ERRA("Process %d called exitMonitor outside of a monitor.", myID);
+int createMailbox(int capacity) {
+	int state = enterKernel();
+	if (nextMailboxId == MAX_MAILBOXES){
+		ERR("Maximum number of mailboxes reached!\n");
+		exit(1);
+	}
+	if (capacity <= 0 || capacity > MAILBOX_POOL_SIZE - mailboxPoolUsed) {
+		ERRA("Cannot create a mailbox of %d messages.", capacity);
 		exit(1);
 	}
+	MailboxDescriptor* mb = &mailboxes[nextMailboxId];
+	mb->messages = &mailboxPool[mailboxPoolUsed];
+	mb->capacity = capacity;
+	mb->first = 0;
+	mb->count = 0;
+	mb->senders.head = -1;
+	mb->senders.tail = -1;
+	mb->receivers.head = -1;
+	mb->receivers.tail = -1;
+	mailboxPoolUsed += capacity;
+	int id = nextMailboxId;
+	nextMailboxId++;
+	leaveKernel(state);
+	return id;
+}
 
-	/* go backwards in the stack of called monitors */
-	processes[myID].currentMonitor--;
+static MailboxDescriptor* getMailbox(int mailboxID) {
+	if (mailboxID >= nextMailboxId || mailboxID < 0) {
+		ERRA("Mailbox %d does not exist.", mailboxID);
+		exit(1);
+	}
+	return &mailboxes[mailboxID];
+}
 
-	if (--monitors[myMonitor].timesTaken == 0) {
-		/* see if someone is waiting, and if yes, let the next process in */
-		if (!isEmpty(&(monitors[myMonitor].entryList))) {
-			int pid = removeHead(&(monitors[myMonitor].entryList));
-			addLast(&readyList, pid);
-			monitors[myMonitor].timesTaken = 1;
-			monitors[myMonitor].takenBy = pid;
-		} else {
-			monitors[myMonitor].takenBy = -1;
+/* Copy up to n messages in, blocking while the mailbox is full. A receiver
+ * is only woken when the mailbox goes from empty to not empty. Returns the
+ * number of messages sent, less than n only on timeout. */
+static int mailboxPut(int mailboxID, const int* messages, int n, int timed, unsigned int expires) {
+	MailboxDescriptor* mb = getMailbox(mailboxID);
+	int myID = currentPid();
+	int sent = 0;
+
+	while (sent < n) {
+		while (mb->count == mb->capacity) {
+			if (!blockOn(&mb->senders, timed, expires)) {
+				goto done;
+			}
+		}
+		int wasEmpty = mb->count == 0;
+		int last = mb->first + mb->count;
+		if (last >= mb->capacity) {
+			last -= mb->capacity;
+		}
+		while (sent < n && mb->count < mb->capacity) {
+			mb->messages[last] = messages[sent++];
+			if (++last == mb->capacity) {
+				last = 0;
+			}
+			mb->count++;
+		}
+		if (wasEmpty) {
+			wakeFirst(&mb->receivers);
 		}
 	}
 
-	allowInterrupts();
+done:
+	/* let the next blocked sender use the room left */
+	if (mb->count < mb->capacity) {
+		wakeFirst(&mb->senders);
+	}
+	clockReschedule();
+	preemptIfNeeded(myID);
+	return sent;
 }
 
-void notify() {
-	maskInterrupts();
-
-	int myID = head(&readyList);
-	int myMonitor = getCurrentMonitor(myID);
+/* Copy up to max messages out, blocking while the mailbox is empty.
+ * Returns the number of messages received, 0 only on timeout. */
+static int mailboxGet(int mailboxID, int* messages, int max, int timed, unsigned int expires) {
+	MailboxDescriptor* mb = getMailbox(mailboxID);
+	int myID = currentPid();
+	int received = 0;
 
-	if (myMonitor < 0) {
-		ERRA("Process %d called notify outside of a monitor.", myID);
-		exit(1);
+	while (mb->count == 0) {
+		if (!blockOn(&mb->receivers, timed, expires)) {
+			goto done;
+		}
 	}
-
-	if (!isEmpty(&(monitors[myMonitor].waitingList))) {
-		int pid = removeHead(&monitors[myMonitor].waitingList);
-		timedWaiting[pid] = 0;
-		addLast(&monitors[myMonitor].entryList, pid);
+	int wasFull = mb->count == mb->capacity;
+	while (received < max && mb->count > 0) {
+		messages[received++] = mb->messages[mb->first];
+		if (++mb->first == mb->capacity) {
+			mb->first = 0;
+		}
+		mb->count--;
+	}
+	if (wasFull) {
+		wakeFirst(&mb->senders);
 	}
 
-	allowInterrupts();
+done:
+	/* let the next blocked receiver take what is left */
+	if (mb->count > 0) {
+		wakeFirst(&mb->receivers);
+	}
+	clockReschedule();
+	preemptIfNeeded(myID);
+	return received;
 }
 
-void notifyAll() {
-	maskInterrupts();
+void send(int mailboxID, int message) {
+	int state = enterKernel();
+	mailboxPut(mailboxID, &message, 1, 0, 0);
+	leaveKernel(state);
+}
 
-	int myID = head(&readyList);
-	int myMonitor = getCurrentMonitor(myID);
+int receive(int mailboxID) {
+	int message;
+	int state = enterKernel();
+	mailboxGet(mailboxID, &message, 1, 0, 0);
+	leaveKernel(state);
+	return message;
+}
 
-	if (myMonitor < 0) {
-		ERRA("Process %d called notify outside of a monitor.", myID);
+int timedSend(int mailboxID, int message, int msec) {
+	int state = enterKernel();
+	if(msec < 0) {
+		ERR("[timedSend] Please provide a valid timeout");
 		exit(1);
 	}
+	int sent = mailboxPut(mailboxID, &message, 1, 1, nowTick() + timerTicks(msec));
+	leaveKernel(state);
+	return sent;
+}
 
-	while (!isEmpty(&(monitors[myMonitor].waitingList))) {
-		int pid = removeHead(&monitors[myMonitor].waitingList);
-		timedWaiting[pid] = 0;
-		addLast(&monitors[myMonitor].entryList, pid);
+int timedReceive(int mailboxID, int* message, int msec) {
+	int state = enterKernel();
+	if(msec < 0) {
+		ERR("[timedReceive] Please provide a valid timeout");
+		exit(1);
 	}
-	allowInterrupts();
+	int received = mailboxGet(mailboxID, message, 1, 1, nowTick() + timerTicks(msec));
+	leaveKernel(state);
+	return received;
+}
+
+void sendN(int mailboxID, const int* messages, int n) {
+	int state = enterKernel();
+	mailboxPut(mailboxID, messages, n, 0, 0);
+	leaveKernel(state);
 }
 
+int receiveN(int mailboxID, int* messages, int max) {
+	int state = enterKernel();
+	int received = mailboxGet(mailboxID, messages, max, 0, 0);
+	leaveKernel(state);
+	return received;
+}
 
 void idle_code() {
 	unsigned int the_answer = 42;
 	while(the_answer == 42) {
 		// Everything is fine
+		waitForInterrupt();
 	}
 }
 int createIdle() {
@@ -327,140 +2154,316 @@ int createIdle() {
     return result;
 }
 
-// Clock process
-void scheduler() {
-	maskInterrupts();
+/* wake up a process whose sleep or timedWait timeout has expired */
+static void timerExpired(int i) {
+	timedWaiting[i] = TIMER_NONE;
+	TRACE_TIMEOUT(i);
+
+	/* If it is in a monitor's waiting list, remove from that list */
+	int currMon = processes[i].timerMonitor;
+	if (currMon >= 0) {
+
+		if (processes[i].waitEpoch != processes[i].waitQueue->notifyAllEpoch) {
+			// Already moved to the entry list by notifyAll
+			return;
+		}
+		timedWaiting[i] = TIMER_EXPIRED;
+		removeFromList(&processes[i].waitQueue->waitingList, i);
+		if (monitors[currMon].timesTaken > 0) {
+			addLast(&monitors[currMon].entryList, i);
+		} else {
+			monitors[currMon].timesTaken = 1;
+			monitors[currMon].takenBy = i;
+			readyAddFirst(i);
+		}
+	} else {
+		if (processes[i].timerList != NULL) {
+			removeFromList(processes[i].timerList, i);
+		}
+		timedWaiting[i] = TIMER_EXPIRED;
+		readyAddFirst(i);
+	}
+}
+
+/* advance the clock by one tick and expire the timers of that tick */
+static void timerTick() {
 	int i;
+	int next;
 
-	// Enable clock interrupts
-	init_clock();
-	init_button();
-	unsigned int time_since_last_commutation = 0;
-	while(1) {
-		int next_pid = !isEmpty(&readyList) ? head(&readyList) : idle_pid;
-		iotransfer(processes[next_pid].p, 0);
-
-		// Rising edge has happened!
-		time_since_last_commutation += CLOCK_PERIOD;
-
-
-		/* **********/
-		/* CHECK 1  */
-		/* **********/
-		// Should we switch process? (scheduling part)
-		if(time_since_last_commutation > TIME_SLICING_FREQUENCY) {
-			int current = removeHead(&readyList);
-			addLast(&readyList, current);
-			time_since_last_commutation = 0;
-		}
-
-		/* **********/
-		/* CHECK 2  */
-		/* **********/
-		/* All the processes that have called timedWait and have not been notified / kicked out
-		 * are in the timedWaiting list.
-		 * We check one by one that none of them has timed out */
-		int dbg_proc_waiting = 0;
-		for(i = 0; i < MAX_PROC ; ++i) { // considering MAX_PROC is small, not a big performance deal
-			if (timedWaiting[i]) {
-				dbg_proc_waiting++;
-				int* timeout = &(processes[i].timeout);
-				if(*timeout <= 0) {
-					// Here, the process has timed out but was not notified
-					continue;
-				}
+	currentTick++;
+	int slot = currentTick & (TIMER_WHEEL_SIZE - 1);
+
+	/* once per revolution, bring the long timeouts that are now in range
+	 * into the wheel */
+	if (slot == 0) {
+		for (i = head(&timerWheel[TIMER_OVERFLOW]); i != -1; i = next) {
+			next = processes[i].timerNext;
+			int newSlot = timerSlotFor(processes[i].timerExpires);
+			if (newSlot != TIMER_OVERFLOW) {
+				timerSlotRemove(i);
+				timerSlotAdd(newSlot, i);
+			}
+		}
+	}
+
+	/* everything in the slot expires now */
+	while ((i = head(&timerWheel[slot])) != -1) {
+		timerSlotRemove(i);
+		timerExpired(i);
+	}
+}
+
+/* advance the clock by ticks ticks, expiring timers on the way */
+static void timerAdvance(unsigned int ticks) {
+	while (ticks-- > 0) {
+		timerTick();
+	}
+}
+
+#ifdef TICKLESS
+/* number of ticks until the clock interrupt has something to do */
+static unsigned int nextDeadline() {
+	unsigned int ticks = TICKLESS_MAX_TICKS;
+	unsigned int d;
+
+	/* end of the quantum, if another process of the same priority waits */
+	int current = readyHead();
+	if (current != -1 && processes[current].next != -1 && processes[current].priority >= 0) {
+		unsigned int used = processes[current].sliceUsed / CLOCK_PERIOD;
+		unsigned int slice = quantumOf(processes[current].priority) / CLOCK_PERIOD;
+		ticks = used < slice ? slice - used : 1;
+	}
 
-				*timeout -= CLOCK_PERIOD;
+#ifdef MLFQ
+	d = nextBoost - currentTick;
+	if (d < ticks) {
+		ticks = d;
+	}
+#endif
 
+	/* first non empty slot of the timer wheel */
+	for (d = 1; d < ticks && d < TIMER_WHEEL_SIZE; ++d) {
+		if (!isEmpty(&timerWheel[(currentTick + d) & (TIMER_WHEEL_SIZE - 1)])) {
+			return d;
+		}
+	}
 
-				if(*timeout <= 0) {
+	/* long timeouts need the end of revolution scan */
+	if (!isEmpty(&timerWheel[TIMER_OVERFLOW])) {
+		d = TIMER_WHEEL_SIZE - (currentTick & (TIMER_WHEEL_SIZE - 1));
+		if (d < ticks) {
+			ticks = d;
+		}
+	}
+	return ticks;
+}
 
-					/* If it is in a monitor's waiting list, remove from that list */
-					int currMon = getCurrentMonitor(i);
-					if (currMon >= 0 && monitors[currMon].takenBy != i) {
+#endif
 
-						int* list = &(monitors[currMon].waitingList);
-						removeFromList(list, i);
-						if (monitors[currMon].timesTaken > 0) {
-							addLast(&monitors[currMon].entryList, i);
-						} else {
-							monitors[currMon].timesTaken = 1;
-							monitors[currMon].takenBy = i;
-							addFirst(&readyList, i);
-						}
-					} else {
-						addFirst(&readyList, i);
-					}
-				}
+/* called by kernel calls that armed a timer or readied a process: in
+ * tickless mode, fire the clock earlier if the next deadline moved up */
+static void clockReschedule() {
+#ifdef TICKLESS
+	if (!clockStarted) {
+		return;
+	}
+	unsigned int ticks = nextDeadline();
+	if (ticks < clockProgrammed) {
+		/* a time slice may already be over */
+		unsigned int elapsed = clock_elapsed();
+		if (ticks <= elapsed) {
+			ticks = elapsed + 1;
+		}
+		if (ticks < clockProgrammed && program_clock(ticks)) {
+			clockProgrammed = ticks;
+		}
+	}
+#endif
+}
 
+#ifdef MLFQ
+/* every process back to its initial level, at the tail for those ready */
+static void boostPriorities() {
+	int pid;
+	for (pid = 0; pid < nextProcessId; ++pid) {
+		ProcessDescriptor* p = &processes[pid];
+		if (p->state != PROC_ALIVE || p->priority == p->basePriority) {
+			continue;
+		}
+		if (p->runState == RUN_READY) {
+			readyRemove(pid);
+			p->priority = p->basePriority;
+			readyAddLast(pid);
+		} else {
+			p->priority = p->basePriority;
+		}
+		p->sliceUsed = 0;
+	}
+}
+#endif
+
+/* The process running on core used ticks of its quantum; once it used it
+ * all, it goes to the back of its level, or of the level below with MLFQ.
+ * Time an idle process ran is not charged to anyone. In tickless mode, all
+ * the ticks since the last interrupt are charged to the process
+ * interrupted. */
+static void chargeSlice(int core, unsigned int ticks) {
+	int current = runningPid[core];
+	if (current >= 0 && current == coreHead(core) && processes[current].priority >= 0) {
+		processes[current].sliceUsed += ticks * CLOCK_PERIOD;
+		if (processes[current].sliceUsed >= quantumOf(processes[current].priority)) {
+			readyRemove(current);
+#ifdef MLFQ
+			if (processes[current].priority < NUM_PRIORITIES - 1) {
+				processes[current].priority++;
 			}
-			
+#endif
+			readyAddLast(current);
+			processes[current].sliceUsed = 0;
 		}
 	}
-	allowInterrupts();
 }
-int createScheduler() {
-	int result = createSpecialProcess(&scheduler);
-	return result;
+
+/* Clock interrupt, called by its handler on the stack of the process it
+ * interrupted, ticks clock periods after the last one: the process is
+ * charged its time slice and the timeouts of those ticks expire. It only
+ * switches if another process must run now. */
+static void clockTick(unsigned int ticks) {
+	int core;
+	lockKernel();
+	unsigned int start = statsTimestamp();
+	clockInterrupts++;
+
+	/* the interrupted process, and with SMP the processes running on the
+	 * other cores, are charged the ticks */
+	for (core = 0; core < CORES; ++core) {
+		chargeSlice(core, ticks);
+	}
+
+	/* wake up the processes whose sleep or timedWait expires now */
+	timerAdvance(ticks);
+
+#ifdef MLFQ
+	if ((int)(currentTick - nextBoost) >= 0) {
+		boostPriorities();
+		nextBoost = currentTick + MLFQ_BOOST_PERIOD / CLOCK_PERIOD;
+	}
+#endif
+
+#ifdef TICKLESS
+	clockProgrammed = nextDeadline();
+	program_clock(clockProgrammed);
+#endif
+	tickCounts += statsTimestamp() - start;
+#ifdef SMP
+	/* the other cores switch if another process comes first now, or take
+	 * one if they are idle and some core has one waiting */
+	for (core = 0; core < CORES; ++core) {
+		int head = coreHead(core);
+		if (core != thisCore() && (head != -1 ? head != runningPid[core] : spareWork())) {
+			kick(core);
+		}
+	}
+#endif
+	preemptFromISR();
+	unlockKernel();
 }
 
-void waitInterrupt(int peripherique) {
-	maskInterrupts();
+int waitInterruptEvents(int peripherique, InterruptEvent* events, int max) {
+	int state = enterKernel();
 
 	if(peripherique == 0) {
 		ERR("Error, you are not allowed to wait clock interrupts ");
 		exit(1);
 	}
-	int caller_pid = removeHead(&readyList);
+	if(peripherique < 0 || peripherique >= NUM_INTERRUPT_DEVICES) {
+		ERRA("Interrupt device %d does not exist.", peripherique);
+		exit(1);
+	}
+
+#ifdef SMP
+	/* the devices interrupt core 0, where the handler transfers to us */
+	int me = currentPid();
+	processes[me].pinned = 1;
+	if (processes[me].core != 0) {
+		readyRemoveHead();
+		processes[me].core = 0;
+		readyAddLast(me);
+		checkAndTransfer();
+	}
+#endif
+
+	/* events that arrived while we were busy are returned at once */
+	if(!interrupt_pending(peripherique)) {
+		int caller_pid = readyRemoveHead();
+
+		int next_pid = nextToRun();
 
-	int next_pid = isEmpty(&readyList) ? idle_pid : head(&readyList);
+		accountSwitch(next_pid);
+		iotransfer(processes[next_pid].p, peripherique);
+		accountSwitch(caller_pid);
 
-	iotransfer(processes[next_pid].p, peripherique);
+		// When we get back here, an interruption has happened :
+		// we regive the CPU to the caller, unless a higher priority
+		// process is ready
+		readyAddFirst(caller_pid);
+		clockReschedule();
+		preemptIfNeeded(caller_pid);
+	}
+
+	int n = interrupt_read(peripherique, events, max);
 
-	// When we get back here, an interruption has happened :
-	// we regive the CPU to the caller
-	addFirst(&readyList, caller_pid);
+	leaveKernel(state);
+	return n;
+}
 
-	allowInterrupts();
+int waitInterrupt(int peripherique) {
+	InterruptEvent event;
+	/* a wakeup may find no event left to read: wait for the next one */
+	while (waitInterruptEvents(peripherique, &event, 1) == 0) {
+	}
+	return event.data;
 }
 
 
 
 
 void wait() {
-	maskInterrupts();
+	int state = enterKernel();
 
 	_wait();
 
-	allowInterrupts();
+	leaveKernel(state);
 }
 
 void _wait() {
-	int myID = head(&readyList);
-	int myMonitor = getCurrentMonitor(myID);
-	int myTaken;
+	int myID = currentPid();
 
-	if (myMonitor < 0) {
+	if (getCurrentMonitor(myID) < 0) {
 		ERRA("Process %d called wait outside of a monitor.", myID);
 		exit(1);
 	}
+	waitOnQueue(&monitors[getCurrentMonitor(myID)].condition);
+}
+
+/* wait on a condition queue of the current monitor */
+static void waitOnQueue(ConditionQueue* queue) {
+	int myID = currentPid();
+	int myMonitor = getCurrentMonitor(myID);
+	int myTaken;
 
-	removeHead(&readyList);
-	addLast(&monitors[myMonitor].waitingList, myID);
+	TRACE_MONITOR(TRACE_EV_MON_WAIT, myMonitor, myID);
+	readyRemoveHead();
+	processes[myID].runState = RUN_MONITOR;
+	addLast(&queue->waitingList, myID);
+	processes[myID].waitQueue = queue;
+	processes[myID].waitEpoch = queue->notifyAllEpoch;
 
 	/* save timesTaken so we can restore it later */
 	myTaken = monitors[myMonitor].timesTaken;
 
-	/* let the next process in, if any */
-	if (!isEmpty(&(monitors[myMonitor].entryList))) {
-		int pid = removeHead(&(monitors[myMonitor].entryList));
-		addLast(&readyList, pid);
-		monitors[myMonitor].timesTaken = 1;
-		monitors[myMonitor].takenBy = pid;
-	} else {
-		monitors[myMonitor].timesTaken = 0;
-		monitors[myMonitor].takenBy = -1;
-	}
+	passMonitor(myMonitor);
+	clockReschedule();
 	checkAndTransfer();
 
 	/* I am woken up by exitMonitor -- check if the monitor state is consistent */
@@ -474,65 +2477,158 @@ void _wait() {
 }
 
 int timedWait(int time) {
-	maskInterrupts();
-	
+	int state = enterKernel();
+
+	int myPid = currentPid();
+
+	if (getCurrentMonitor(myPid) < 0) {
+		ERRA("Process %d called wait outside of a monitor.", myPid);
+		exit(1);
+	}
+	int returnValue = timedWaitOnQueue(&monitors[getCurrentMonitor(myPid)].condition, time);
+
+	leaveKernel(state);
+
+	return returnValue;
+}
+
+static int timedWaitOnQueue(ConditionQueue* queue, int time) {
 	if(time < 0) {
 		ERR("[TimedWait] Please provide a valid timeout");
 		exit(1);
 	}
 	
-	int myPid = head(&readyList);
+	int myPid = currentPid();
 	int returnValue = 1;
 
 	// Mark that the process is waiting
-	processes[myPid].timeout = time;
-	timedWaiting[myPid] = 1;
+	addTimer(myPid, time);
+	processes[myPid].timerMonitor = getCurrentMonitor(myPid);
 
-	wait();
+	waitOnQueue(queue);
 	
-	if(timedWaiting[myPid] != 0) {
+	if(timedWaiting[myPid] == TIMER_EXPIRED) {
 		returnValue = 0;
-		timedWaiting[myPid] = 0;
 	}
-	
-	allowInterrupts();
+	// Disarm a timeout left over by notifyAll
+	removeTimer(myPid);
 	
 	return returnValue;
 }
 
 void sleep(int time) {
-	maskInterrupts();
+	int state = enterKernel();
 
 	if(time < 0) {
 		ERR("[sleep] Please provide a valid timeout");
 		exit(1);
 	}
 
-	int myPid = removeHead(&readyList);
-
-	timedWaiting[myPid] = 1;
-	processes[myPid].timeout = time;
+	int myPid = readyRemoveHead();
 
-	if ( isEmpty(&readyList)) {
-		transfer(processes[idle_pid].p);
-	} else {
-		transfer(processes[head(&readyList)].p);
-	}
+	addTimer(myPid, time);
+	processes[myPid].timerMonitor = -1;
+	clockReschedule();
+	checkAndTransfer();
 	//timedWaiting[myPid] = 0;
 
-	allowInterrupts();
+	leaveKernel(state);
+}
+#ifdef SMP
+/* Interrupt sent by kick: another core changed what this one should run */
+static void coreKicked() {
+	lockKernel();
+	kickPending[thisCore()] = 0;
+	preemptFromISR();
+	unlockKernel();
+}
+#endif
+
+/* each core, interrupts masked, gives itself to its first process */
+static void startCore() {
+	lockKernel();
+	int pid = nextToRun();
+	accountSwitch(pid);
+	transfer(processes[pid].p);
 }
+
 void start(){
+	int core;
 
-	if(isEmpty(&readyList)) {
+	if(readyIsEmpty()) {
 		ERR("No processes in the ready list! Exiting...");
 		exit(1);
 	}
 	DPRINT("Starting kernel...");
 
-	idle_pid = createIdle();
-	scheduler_pid = createScheduler();
+	for (core = 0; core < CORES; ++core) {
+		idlePids[core] = createIdle();
+#ifdef SMP
+		processes[idlePids[core]].core = core;
+#endif
+	}
+
+	/* the first process starts with interrupts allowed */
+	maskInterrupts();
+#ifdef MLFQ
+	nextBoost = currentTick + MLFQ_BOOST_PERIOD / CLOCK_PERIOD;
+#endif
+	init_clock(clockTick);
+	init_button();
+#ifdef SMP
+	init_ipi(coreKicked);
+	kernelStarted = 1;
+	start_cores(startCore);
+#endif
+#ifdef TICKLESS
+	clockStarted = 1;
+#endif
+	startCore();
+}
+
+#ifdef STATIC_CONFIG
+
+/* a static stack for each configured process */
+#define CONFIG_STACK(entry, stackSize, ...) \
+	void entry(); \
+	static unsigned int entry##Stack[((stackSize) + 15) / 16 * 4] __attribute__((aligned(16)));
+CONFIG_PROCESSES(CONFIG_STACK)
+CONFIG_PERIODIC_PROCESSES(CONFIG_STACK)
+
+/* create the objects in the order of their ids */
+#define CONFIG_CREATE_MONITOR(name)				createMonitor();
+#define CONFIG_CREATE_CONDITION(name, monitor)	createCondition(monitor);
+#define CONFIG_CREATE_SEMAPHORE(name, initial)	createSemaphore(initial);
+#define CONFIG_CREATE_EVENT_FLAGS(name)			createEventFlags();
+#define CONFIG_CREATE_MAILBOX(name, capacity)	createMailbox(capacity);
+#define CONFIG_CREATE_RW_MONITOR(name, policy)	createRWMonitor(policy);
+#define CONFIG_CREATE_PROCESS(entry, stackSize, priority) \
+	newReadyProcess(entry, entry##Stack, sizeof(entry##Stack), priority);
+#define CONFIG_CREATE_PERIODIC(entry, stackSize, period, budget) \
+	if (newPeriodicProcess(entry, entry##Stack, sizeof(entry##Stack), period, budget) < 0) { \
+		ERRA("Periodic process %s does not fit in EDF_MAX_UTILIZATION.", #entry); \
+		exit(1); \
+	}
 
-	//checkAndTransfer();
-	transfer(processes[scheduler_pid].p);
+#ifdef CONFIG_INIT
+void CONFIG_INIT();
+#endif
+
+int main() {
+	CONFIG_MONITORS(CONFIG_CREATE_MONITOR)
+	CONFIG_CONDITIONS(CONFIG_CREATE_CONDITION)
+	CONFIG_SEMAPHORES(CONFIG_CREATE_SEMAPHORE)
+	CONFIG_EVENT_FLAGS(CONFIG_CREATE_EVENT_FLAGS)
+	CONFIG_MAILBOXES(CONFIG_CREATE_MAILBOX)
+	CONFIG_RW_MONITORS(CONFIG_CREATE_RW_MONITOR)
+#ifdef CONFIG_INIT
+	CONFIG_INIT();
+#endif
+	CONFIG_PROCESSES(CONFIG_CREATE_PROCESS)
+	CONFIG_PERIODIC_PROCESSES(CONFIG_CREATE_PERIODIC)
+
+	start();
+	return 0;
 }
+
+#endif
@@ -1,10 +1,60 @@
 #ifndef KERNEL2_H_
 #define KERNEL2_H_
 
-void createProcess(void (*f)(), int stackSize);
+#include "interrupt.h"
+
+/* Both return the id of the new process. When f returns, the process
+ * exits as if it called exitProcess. The stack comes from the stack pool
+ * (stackpool.h) and may be larger than stackSize. */
+int createProcess(void (*f)(), int stackSize);
+
+/* Priority 0 is the highest; createProcess uses the middle level. Built
+ * with MLFQ, this is the level the process starts at and is boosted back
+ * to; it moves down a level each time it uses a whole quantum. */
+int createProcessWithPriority(void (*f)(), int stackSize, int priority);
+
+/* Periodic process, scheduled earliest deadline first above every
+ * priority. A job is released every period ms, on absolute times, and its
+ * deadline is the next release; f calls waitNextPeriod at the end of each
+ * job. The process is rejected, and -1 returned, if the budget / period
+ * ratios of the periodic processes would exceed EDF_MAX_UTILIZATION
+ * percent. */
+int createPeriodicProcess(void (*f)(), int stackSize, int period, int budget);
+
+/* Ends the current job and waits for the release of the next one. */
+void waitNextPeriod();
+
+/* Number of jobs of periodic process pid that completed after their
+ * deadline. Stops with an error if pid is not an alive periodic
+ * process. */
+int getDeadlineMisses(int pid);
+
+/* Terminates the calling process, which must not be inside a monitor.
+ * Its descriptor and stack are reused by the next processes created. */
+void exitProcess();
+
+/* Blocks until process pid has exited; returns at once if it already has.
+ * Ids are reused, so joining an id that has been given to a new process
+ * waits for the new process. */
+void joinProcess(int pid);
 
 void start();
 
+/* Built with STATIC_CONFIG, the objects of kernelConfig.h get these ids,
+ * and the kernel provides main(), which creates them and starts the
+ * processes. */
+#ifdef STATIC_CONFIG
+#define CONFIG_ID(name, ...)	name,
+#define CONFIG_PID(entry, ...)	entry##Pid,
+enum { CONFIG_PROCESSES(CONFIG_PID) CONFIG_PERIODIC_PROCESSES(CONFIG_PID) CONFIG_PROCESS_COUNT };
+enum { CONFIG_MONITORS(CONFIG_ID) CONFIG_MONITOR_COUNT };
+enum { CONFIG_CONDITIONS(CONFIG_ID) CONFIG_CONDITION_COUNT };
+enum { CONFIG_SEMAPHORES(CONFIG_ID) CONFIG_SEMAPHORE_COUNT };
+enum { CONFIG_EVENT_FLAGS(CONFIG_ID) CONFIG_EVENT_FLAGS_COUNT };
+enum { CONFIG_MAILBOXES(CONFIG_ID) CONFIG_MAILBOX_COUNT };
+enum { CONFIG_RW_MONITORS(CONFIG_ID) CONFIG_RW_MONITOR_COUNT };
+#endif
+
 int createMonitor();
 
 void enterMonitor(int monitorID);
@@ -19,11 +69,135 @@ void notify();
 
 void notifyAll();
 
+/* Named conditions of a monitor, created before start(). waitOn, signal
+ * and broadcast act on the processes waiting for that condition only, and
+ * must be called from inside its monitor. The names avoid signal() of the
+ * C library. */
+int createCondition(int monitorID);
+void waitOn(int condition);
+int timedWaitOn(int condition, int msec);	/* 0 on timeout */
+void signalCondition(int condition);
+void broadcastCondition(int condition);
+
+/* Reader-writer monitors, created before start(): any number of processes
+ * inside in shared mode, or one in exclusive mode. With
+ * RW_WRITER_PREFERRING, readers wait while a writer is waiting, and the
+ * waiting writers go in before the readers; with RW_FIFO, processes go
+ * in in their order of arrival. When the monitor becomes free, all the
+ * readers that may go in are let in at once. They are not nested with
+ * enterMonitor, and wait cannot be called inside. A process may enter
+ * again in shared mode, up to 255 times, unless a writer waits. Entering
+ * in any other way a monitor it is inside, or calling exitRW without
+ * being inside, stops the kernel with an error. */
+#define RW_WRITER_PREFERRING	0
+#define RW_FIFO					1
+
+int createRWMonitor(int policy);
+void enterShared(int rw);
+void enterExclusive(int rw);
+void exitRW(int rw);
+
 void sleep(int msec);
 
+/* Counting semaphores, created before start(). semaphorePost hands the
+ * unit directly to the first waiter, if any. The FromISR variant may be
+ * called from an interrupt handler. */
+int createSemaphore(int initial);
+void semaphoreWait(int semaphore);
+int semaphoreTimedWait(int semaphore, int msec);	/* 0 on timeout */
+void semaphorePost(int semaphore);
+void semaphorePostFromISR(int semaphore);
+
+/* Groups of 32 event flags, created before start(). waitEventFlags returns
+ * when any (or, with EVENT_FLAGS_ALL, all) of the flags given are set, and
+ * returns those of them that are set; EVENT_FLAGS_CLEAR clears them. */
+#define EVENT_FLAGS_ANY		0
+#define EVENT_FLAGS_ALL		1
+#define EVENT_FLAGS_CLEAR	2
+
+int createEventFlags();
+unsigned int waitEventFlags(int group, unsigned int flags, int mode);
+unsigned int timedWaitEventFlags(int group, unsigned int flags, int mode, int msec);	/* 0 on timeout */
+void setEventFlags(int group, unsigned int flags);
+void setEventFlagsFromISR(int group, unsigned int flags);
+void clearEventFlags(int group, unsigned int flags);
+unsigned int getEventFlagsValue(int group);
+
+/* Mailboxes: bounded FIFO queues of int messages, created before start(). */
+int createMailbox(int capacity);
+
+/* Block while the mailbox is full / empty. */
+void send(int mailbox, int message);
+int receive(int mailbox);
+
+/* Same with a timeout; return 1 on success and 0 on timeout. */
+int timedSend(int mailbox, int message, int msec);
+int timedReceive(int mailbox, int* message, int msec);
+
+/* Move several messages per call: sendN returns once all n messages are
+ * queued; receiveN waits for at least one message and takes up to max,
+ * returning how many it took. */
+void sendN(int mailbox, const int* messages, int n);
+int receiveN(int mailbox, int* messages, int max);
+
 void yield();
 
-void waitInterrupt(int per);
+/* Context switches since start(), counting those to and from the idle
+ * process. */
+unsigned int getSwitchCount();
+
+/* CPU accounting of a process, updated at every context switch. Times are
+ * in microseconds, and only measured in builds with PROCESS_STATS (they
+ * are 0 otherwise). */
+typedef struct {
+	unsigned long long runTime;
+	unsigned long long readyTime;		/* ready, waiting for the CPU */
+	unsigned long long monitorTime;		/* blocked entering or waiting in a monitor */
+	unsigned int voluntarySwitches;		/* gave up the CPU to block */
+	unsigned int involuntarySwitches;	/* switched out while still ready: preempted or yield */
+	int priority;						/* current level, -1 for periodic processes */
+	int core;							/* core whose ready queues it is in, 0 without SMP */
+} ProcessStats;
+
+/* Fills stats and returns 1, or returns 0 if process pid does not exist. */
+int getProcessStats(int pid, ProcessStats* stats);
+
+typedef struct {
+	unsigned long long uptime;			/* microseconds, with clock period resolution */
+	unsigned long long idleTime;		/* run time of the idle processes */
+	unsigned long long tickTime;		/* spent handling clock interrupts, part of the run
+										 * time of the processes they interrupted */
+	unsigned int switches;				/* as getSwitchCount */
+	unsigned int preemptions;			/* involuntary switches of the processes alive */
+	unsigned int clockInterrupts;
+	int processes;						/* every pid is below this */
+	int idlePid;						/* idle process of core 0, those of the
+										 * other cores follow it */
+	int cores;
+	unsigned int steals;				/* processes an idle core took from another one */
+	unsigned int kicks;					/* interrupts sent to another core */
+} KernelStats;
+
+void getKernelStats(KernelStats* stats);
+
+/* Stacks are painted when a process is created. stackHighWater returns the
+ * most bytes of its stack process pid has used so far, or -1 if it does
+ * not exist. A process found to have overwritten the bottom of its stack
+ * when it is switched out stops the kernel with an error. */
+int stackHighWater(int pid);
+
+/* Prints the stack size asked for, reserved and used by each process, and
+ * the size recommended from what it used. */
+void stackReport();
+
+/* Waits for the next event of device per, or takes the oldest one at once
+ * if some are pending; returns its data (the edge capture bits for the
+ * buttons). */
+int waitInterrupt(int per);
+
+/* Same, but takes all pending events, up to max, with a single wakeup.
+ * Returns the number of events stored in events, which may be 0. */
+int waitInterruptEvents(int per, InterruptEvent* events, int max);
 
 int createIdle();
 
@@ -0,0 +1,399 @@
+/*
+ * Microbenchmarks of the kernel primitives.
+ *
+ * Each benchmark takes BENCH_SAMPLES timings with clock_timestamp (the
+ * snapshot of the Avalon timer, TIMER_FREQ counts per second), less the
+ * median cost of reading the timer, and prints one CSV line with the
+ * minimum, median, 90th and 99th percentiles and maximum in ns, for
+ * regression tracking.
+ *
+ * On the board, build it instead of kernelTest2.c (make APP=kernelBench),
+ * and press button 0 BENCH_PRESSES times when asked. On the host
+ * (host/Makefile, bench_kernel), the presses are made by a process of the
+ * benchmark through BENCH_PRESS_BUTTON.
+ *
+ * Built with IRQ_LATENCY, a last line gives the lengths of the windows in
+ * which interrupts were masked during the run (interrupt.h), from the
+ * histogram of their length classes: the minimum is rounded down and the
+ * percentiles up to a class bound, the maximum is exact.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "system.h"
+#include "system_m.h"
+#include "interrupt.h"
+#include "kernel2.h"
+
+#define STACK_SIZE		10000
+
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES	1000
+#endif
+#define BENCH_WARMUP	10
+#ifndef BENCH_PRESSES
+#define BENCH_PRESSES	20
+#endif
+#define SLEEP_MS		5
+
+/* priorities: the helpers preempt the runner as soon as they are created */
+#define RUNNER_PRIORITY	4
+#define HELPER_PRIORITY	2
+#define WAITER_PRIORITY	1
+
+#define benchNow()		clock_timestamp()
+
+#ifdef BENCH_PRESS_BUTTON
+void BENCH_PRESS_BUTTON(int button);
+#endif
+
+static int samples[BENCH_SAMPLES];
+static int timerOverhead = 0;
+
+static int compareInts(const void* a, const void* b) {
+	int x = *(const int*)a;
+	int y = *(const int*)b;
+	return (x > y) - (x < y);
+}
+
+static long long countsToNs(int counts) {
+	return (long long)counts * 1000000000LL / TIMER_FREQ;
+}
+
+/* sorts samples[0..n-1] and prints the line */
+static void reportCounts(const char* name, int n) {
+	qsort(samples, n, sizeof(int), compareInts);
+	printf("%s,%d,%lld,%lld,%lld,%lld,%lld\n", name, n,
+			countsToNs(samples[0]), countsToNs(samples[n / 2]),
+			countsToNs(samples[n * 9 / 10]), countsToNs(samples[n * 99 / 100]),
+			countsToNs(samples[n - 1]));
+}
+
+/* same, less the timer overhead */
+static void report(const char* name, int n) {
+	int i;
+	for (i = 0; i < n; ++i) {
+		samples[i] -= timerOverhead;
+	}
+	reportCounts(name, n);
+}
+
+/***************************** timer read *****************************/
+
+static void benchTimer() {
+	int i;
+	for (i = 0; i < BENCH_SAMPLES; ++i) {
+		unsigned int t = benchNow();
+		samples[i] = benchNow() - t;
+	}
+	report("timer_read", BENCH_SAMPLES);
+	/* the median is the overhead of the other measurements */
+	timerOverhead = samples[BENCH_SAMPLES / 2];
+}
+
+/****************************** transfer ******************************/
+
+/* A bare process, outside the kernel, and the runner switching to it with
+ * interrupts masked, so that the kernel never sees the switches. With SMP,
+ * both hold kernel_lock as transfer requires. */
+static Process peerProcess, peerCaller;
+static volatile unsigned int peerStamp;
+static unsigned int peerStack[STACK_SIZE / sizeof(unsigned int)];
+
+static void peerCode() {
+#ifdef SMP
+	/* started by a switch that gave up the lock */
+	maskInterrupts();
+	finishTransfer();
+	spin_lock(&kernel_lock);
+#endif
+	while (1) {
+		/* a new process starts with interrupts enabled */
+		maskInterrupts();
+		peerStamp = benchNow();
+		transfer(peerCaller);
+	}
+}
+
+static void benchTransfer() {
+	int i;
+	maskInterrupts();
+#ifdef SMP
+	spin_lock(&kernel_lock);
+#endif
+	peerProcess = newProcess(peerCode, peerStack, sizeof(peerStack));
+	for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; ++i) {
+		peerCaller = running;
+		unsigned int t = benchNow();
+		transfer(peerProcess);
+		if (i >= 0) {
+			samples[i] = peerStamp - t;
+		}
+	}
+#ifdef SMP
+	spin_unlock(&kernel_lock);
+#endif
+	allowInterrupts();
+	report("transfer", BENCH_SAMPLES);
+}
+
+/******************************** yield *******************************/
+
+/* Two processes of the priority of the runner, which is blocked joining
+ * them, yield to each other: from the yield of one to the return of the
+ * other. */
+static volatile unsigned int yieldStamp;
+static volatile int yieldCount;
+
+static void yielder() {
+	while (yieldCount < BENCH_SAMPLES + BENCH_WARMUP) {
+		unsigned int now = benchNow();
+		int i = yieldCount++ - BENCH_WARMUP;
+		if (i >= 0 && i < BENCH_SAMPLES) {
+			samples[i] = now - yieldStamp;
+		}
+		yieldStamp = benchNow();
+		yield();
+	}
+}
+
+static void benchYield() {
+	yieldCount = 0;
+	int a = createProcessWithPriority(yielder, STACK_SIZE, RUNNER_PRIORITY);
+	int b = createProcessWithPriority(yielder, STACK_SIZE, RUNNER_PRIORITY);
+	joinProcess(a);
+	joinProcess(b);
+	report("yield", BENCH_SAMPLES);
+}
+
+/******************************* monitors *****************************/
+
+static int benchMonitor;
+static int benchSemaphore;
+
+static void benchMonitorUncontended() {
+	int i;
+	for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; ++i) {
+		unsigned int t = benchNow();
+		enterMonitor(benchMonitor);
+		exitMonitor();
+		if (i >= 0) {
+			samples[i] = benchNow() - t;
+		}
+	}
+	report("monitor_uncontended", BENCH_SAMPLES);
+}
+
+/* The runner holds the monitor and lets a higher priority process block
+ * on it: from the exitMonitor of the runner to the return of the
+ * enterMonitor of the other process. */
+static volatile unsigned int exitStamp;
+
+static void contender() {
+	int i;
+	for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; ++i) {
+		semaphoreWait(benchSemaphore);
+		enterMonitor(benchMonitor);
+		if (i >= 0) {
+			samples[i] = benchNow() - exitStamp;
+		}
+		exitMonitor();
+	}
+}
+
+static void benchMonitorContended() {
+	int i;
+	int pid = createProcessWithPriority(contender, STACK_SIZE, HELPER_PRIORITY);
+	for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; ++i) {
+		enterMonitor(benchMonitor);
+		/* the contender runs and blocks on the monitor */
+		semaphorePost(benchSemaphore);
+		exitStamp = benchNow();
+		exitMonitor();
+	}
+	joinProcess(pid);
+	report("monitor_contended", BENCH_SAMPLES);
+}
+
+/* A higher priority process waits in the monitor: from the notify of the
+ * runner to the return of wait, through the exitMonitor of the runner. */
+static volatile unsigned int notifyStamp;
+
+static void notified() {
+	int i;
+	for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; ++i) {
+		enterMonitor(benchMonitor);
+		wait();
+		if (i >= 0) {
+			samples[i] = benchNow() - notifyStamp;
+		}
+		exitMonitor();
+	}
+}
+
+static void benchNotify() {
+	int i;
+	int pid = createProcessWithPriority(notified, STACK_SIZE, HELPER_PRIORITY);
+	for (i = -BENCH_WARMUP; i < BENCH_SAMPLES; ++i) {
+		/* the notified process is waiting: it has the higher priority */
+		enterMonitor(benchMonitor);
+		notifyStamp = benchNow();
+		notify();
+		exitMonitor();
+	}
+	joinProcess(pid);
+	report("notify_wakeup", BENCH_SAMPLES);
+}
+
+/******************************** sleep *******************************/
+
+/* Lateness of sleep(SLEEP_MS), negative if it returns early: the timeout
+ * counts whole clock periods from the last one. */
+static void benchSleep() {
+	int i;
+	int n = BENCH_SAMPLES / 10;
+	for (i = 0; i < n; ++i) {
+		unsigned int t = benchNow();
+		sleep(SLEEP_MS);
+		samples[i] = (int)(benchNow() - t) - SLEEP_MS * (TIMER_FREQ / 1000);
+	}
+	report("sleep_jitter", n);
+}
+
+/******************************** tick ********************************/
+
+/* The runner spins reading the timer, alone at its priority: the read
+ * that crosses the end of a clock period also spans the clock interrupt,
+ * and the time it took from the runner. */
+#define TICK_COUNTS		(TIMER_LOAD_VALUE + 1)
+
+static void benchTick() {
+	int i = -BENCH_WARMUP;
+	int n = BENCH_SAMPLES / 4;
+	unsigned int last = benchNow();
+	while (i < n) {
+		unsigned int t = benchNow();
+		if (t / TICK_COUNTS != last / TICK_COUNTS) {
+			if (i >= 0) {
+				samples[i] = t - last;
+			}
+			++i;
+		}
+		last = t;
+	}
+	report("tick", n);
+}
+
+/****************************** interrupts ****************************/
+
+/* From the handler of the button interrupt to the return of
+ * waitInterruptEvents, the waiter having the highest priority. */
+static int interruptSamples;
+
+static void interruptWaiter() {
+	InterruptEvent event;
+	/* events of presses made before the benchmark */
+	while (interrupt_pending(1)) {
+		waitInterruptEvents(1, &event, 1);
+	}
+	for (interruptSamples = 0; interruptSamples < BENCH_PRESSES; ++interruptSamples) {
+		waitInterruptEvents(1, &event, 1);
+		samples[interruptSamples] = benchNow() - event.stamp;
+	}
+}
+
+#ifdef BENCH_PRESS_BUTTON
+static void presser() {
+	int pressed = -1;
+	while (interruptSamples < BENCH_PRESSES) {
+		if (pressed != interruptSamples) {
+			pressed = interruptSamples;
+			BENCH_PRESS_BUTTON(0);
+		}
+		yield();
+	}
+}
+#endif
+
+static void benchInterrupt() {
+	int pid = createProcessWithPriority(interruptWaiter, STACK_SIZE, WAITER_PRIORITY);
+#ifdef BENCH_PRESS_BUTTON
+	int presserPid = createProcessWithPriority(presser, STACK_SIZE, HELPER_PRIORITY);
+	joinProcess(presserPid);
+#else
+	fprintf(stderr, "Press button 0 %d times.\n", BENCH_PRESSES);
+#endif
+	joinProcess(pid);
+	report("interrupt_wakeup", BENCH_PRESSES);
+}
+
+/*************************** masked windows ***************************/
+
+#ifdef IRQ_LATENCY
+static long long classNs(unsigned long long counts) {
+	return counts * 1000000000LL / TIMER_FREQ;
+}
+
+/* upper bound of the class holding the window of the given rank */
+static long long classRankNs(unsigned int* classes, int n, unsigned int rank) {
+	unsigned int seen = 0;
+	int class;
+	for (class = 0; class < n; ++class) {
+		seen += classes[class];
+		if (seen > rank) {
+			break;
+		}
+	}
+	return classNs((2ULL << class) - 1);
+}
+
+static void benchIrqMasked() {
+	unsigned int classes[IRQ_LATENCY_CLASSES];
+	int n = irq_masked_histogram(classes);
+	unsigned int total = 0;
+	int first = -1;
+	int class;
+	for (class = 0; class < n; ++class) {
+		if (first < 0 && classes[class] != 0) {
+			first = class;
+		}
+		total += classes[class];
+	}
+	if (total == 0) {
+		return;
+	}
+	printf("irq_masked_window,%u,%lld,%lld,%lld,%lld,%lld\n", total,
+			first == 0 ? 0 : classNs(1ULL << first),
+			classRankNs(classes, n, total / 2),
+			classRankNs(classes, n, total / 10 * 9),
+			classRankNs(classes, n, total / 100 * 99),
+			classNs(irq_masked_max()));
+}
+#endif
+
+/**********************************************************************/
+
+static void runner() {
+	printf("benchmark,samples,min_ns,median_ns,p90_ns,p99_ns,max_ns\n");
+	benchTimer();
+	benchTransfer();
+	benchYield();
+	benchMonitorUncontended();
+	benchMonitorContended();
+	benchNotify();
+	benchSleep();
+	benchTick();
+	benchInterrupt();
+#ifdef IRQ_LATENCY
+	benchIrqMasked();
+#endif
+	fflush(stdout);
+	exit(0);
+}
+
+int main() {
+	benchMonitor = createMonitor();
+	benchSemaphore = createSemaphore(0);
+	createProcessWithPriority(runner, STACK_SIZE, RUNNER_PRIORITY);
+	start();
+	return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef KERNELCONFIG_H_
+#define KERNELCONFIG_H_
+
+/*
+ * Static configuration of kernelTest2, used when built with STATIC_CONFIG.
+ *
+ * Every kernel object is listed here, and the kernel sizes its tables to
+ * fit exactly, gives each process a static stack of its own, creates the
+ * objects in this order and starts the processes from its own main(): the
+ * heap is never used. Each object name below becomes an enum constant of
+ * kernel2.h holding its id, and each process entry a constant entryPid.
+ *
+ * Every list must be defined, empty if there is nothing to declare.
+ */
+
+/* Stack of the application processes, in bytes. stackReport (kernel2.h)
+ * gives the sizes actually used. */
+#ifndef APP_STACK_SIZE
+#define APP_STACK_SIZE	4096
+#endif
+
+/* PROCESS(entry, stack size, priority) */
+#ifdef STACK_REPORT_AFTER
+#define REPORT_PROCESS(PROCESS)	PROCESS(reportStacks, APP_STACK_SIZE, DEFAULT_PRIORITY)
+#else
+#define REPORT_PROCESS(PROCESS)
+#endif
+#define CONFIG_PROCESSES(PROCESS) \
+	PROCESS(producer, APP_STACK_SIZE, DEFAULT_PRIORITY) \
+	PROCESS(consumer, APP_STACK_SIZE, DEFAULT_PRIORITY) \
+	REPORT_PROCESS(PROCESS)
+
+/* PERIODIC(entry, stack size, period in ms, budget in ms) */
+#define CONFIG_PERIODIC_PROCESSES(PERIODIC) \
+	PERIODIC(countAndDisplay, APP_STACK_SIZE, 100, 10)
+
+/* Processes that may be created at run time, with stacks from the stack
+ * pool, whose class counts default to 0 here */
+#define CONFIG_DYNAMIC_PROCESSES	0
+
+/* MONITOR(name) */
+#define CONFIG_MONITORS(MONITOR) \
+	MONITOR(b0Monitor)
+
+/* CONDITION(name, monitor) */
+#define CONFIG_CONDITIONS(CONDITION) \
+	CONDITION(b0NotFull, b0Monitor) \
+	CONDITION(b0NotEmpty, b0Monitor)
+
+/* SEMAPHORE(name, initial count) */
+#define CONFIG_SEMAPHORES(SEMAPHORE)
+
+/* EVENT_FLAGS(name) */
+#define CONFIG_EVENT_FLAGS(EVENT_FLAGS)
+
+/* MAILBOX(name, capacity) */
+#define CONFIG_MAILBOXES(MAILBOX)
+
+/* RW_MONITOR(name, RW_WRITER_PREFERRING or RW_FIFO) */
+#define CONFIG_RW_MONITORS(RW_MONITOR)
+
+/* Function called once the objects exist, before the processes start */
+#define CONFIG_INIT	initApplication
+
+/* Interrupt devices: the clock and the buttons, and the events kept for
+ * each until they are read */
+#define NUM_INTERRUPT_DEVICES	2
+#define INTERRUPT_RING_SIZE		8
+
+/* Stack pool classes, for the dynamic processes */
+#ifndef STACK_CLASS_0_COUNT
+#define STACK_CLASS_0_COUNT	0
+#endif
+#ifndef STACK_CLASS_1_COUNT
+#define STACK_CLASS_1_COUNT	0
+#endif
+#ifndef STACK_CLASS_2_COUNT
+#define STACK_CLASS_2_COUNT	0
+#endif
+
+#endif /*KERNELCONFIG_H_*/
@@ -4,9 +4,13 @@
 #include "interrupt.h"
 #include "altera_avalon_pio_regs.h"
 #include "kernel2.h"
+#include "trace.h"
+#include "top.h"
+#include "stackpool.h"
 
 #define STACK_SIZE		10000
 #define INTERVAL		100
+#define BUDGET			10		/* ms of CPU per INTERVAL reserved for countAndDisplay */
 #define FREEZE_FOR		3000
 
 #define RESET			0x1111
@@ -14,15 +18,34 @@
 #define STOP			0x3333
 #define TIMEOUT			0xFFFF
 
+/* build with -DPROCESS_STATS -DTOP_INTERVAL=ms to print the CPU accounting
+ * periodically, and with -DSTACK_REPORT_AFTER=ms to print the stack use of
+ * the processes once they have run that long */
+
+/* where button 3 writes the kernel trace, in builds with TRACE_CATEGORIES */
+#ifndef TRACE_FILE
+#define TRACE_FILE		"trace.bin"
+#endif
+
 /*********************** Buffer implemented using monitors *********************/
 typedef struct {
 	int message;
 	int full;
 	int monitor;
+	int notFull;		/* conditions of monitor */
+	int notEmpty;
 } Buffer;
 
 void initBuffer(Buffer* b) {
+#ifdef STATIC_CONFIG
+	b->monitor = b0Monitor;
+	b->notFull = b0NotFull;
+	b->notEmpty = b0NotEmpty;
+#else
 	b->monitor = createMonitor();
+	b->notFull = createCondition(b->monitor);
+	b->notEmpty = createCondition(b->monitor);
+#endif
 	b->full = 0;
 }
 
@@ -30,11 +53,11 @@ void put(Buffer* b, int m) {
 	printf("put\n");
 	enterMonitor(b->monitor);
 	while(b->full) {
-		wait();
+		waitOn(b->notFull);
 	}
 	b->message = m;
 	b->full = 1;
-	notify();
+	signalCondition(b->notEmpty);
 	exitMonitor();
 
 	return;
@@ -46,12 +69,12 @@ int get(Buffer* b) {
 
 	enterMonitor(b->monitor);
 	while (!b->full) {
-		wait();
+		waitOn(b->notEmpty);
 	}
 	printf("got\n");
 	m = b->message;
 	b->full = 0;
-	notifyAll();
+	signalCondition(b->notFull);
 	exitMonitor();
 
 	return m;
@@ -63,13 +86,13 @@ int timedGet(Buffer *b, int timeout) {
 
 	enterMonitor(b->monitor);
 	if (!b->full) {
-		ret = timedWait(timeout);
+		ret = timedWaitOn(b->notEmpty, timeout);
 	}
 	if (ret) {
 		m = b->message;
 		b->full = 0;
 		printf("timedgot\n");
-		notifyAll();
+		signalCondition(b->notFull);
 	} else {
 		m = TIMEOUT;
 		printf("timedout\n");
@@ -102,14 +125,25 @@ void displayNumber(int no) {
 	displayDigit(0, no / 100);
 }
 
+void dumpTrace() {
+#if TRACE_CATEGORIES
+	FILE* f = fopen(TRACE_FILE, "wb");
+	if (f != NULL) {
+		trace_dump(f);
+		fclose(f);
+		printf("Trace written to %s.\n", TRACE_FILE);
+	}
+#endif
+}
+
 void producer(){
 	int temp;
 
 	printf("Producer starting...\n");
 
 	while(1) {
-		waitInterrupt(1);
-		temp = edge_capture;
+		/* one event per press, even if we were still in put() */
+		temp = waitInterrupt(1);
 		if (temp != 0) {
 
 			/* check button 0 */
@@ -132,7 +166,12 @@ void producer(){
 				put(&b0, STOP);
 			}
 
-			/* button 3 ignored */
+			/* check button 3 */
+			temp = temp >> 1;
+			if (temp%2==1) {
+
+				dumpTrace();
+			}
 		}
 	}
 }
@@ -188,18 +227,40 @@ void countAndDisplay() {
 			reset = 0;
 		}
 
-		sleep(INTERVAL);
+		waitNextPeriod();
 	}
 }
 
-int main() {
+#ifdef STACK_REPORT_AFTER
+void reportStacks() {
+	sleep(STACK_REPORT_AFTER);
+	stackReport();
+	stackPoolReport();
+}
+#endif
+
+void initApplication() {
 	IOWR_ALTERA_AVALON_PIO_DATA(LED_COLOR_BASE, LED_COLOR_RESET_VALUE);
 	initBuffer(&b0);
+}
+
+/* built with STATIC_CONFIG, the kernel starts the processes of
+ * kernelConfig.h from its own main */
+#ifndef STATIC_CONFIG
+int main() {
+	initApplication();
 
 	createProcess(producer, STACK_SIZE);
 	createProcess(consumer, STACK_SIZE);
-	createProcess(countAndDisplay, STACK_SIZE);
+	createPeriodicProcess(countAndDisplay, STACK_SIZE, INTERVAL, BUDGET);
+#ifdef TOP_INTERVAL
+	createTopProcess(STACK_SIZE, TOP_INTERVAL);
+#endif
+#ifdef STACK_REPORT_AFTER
+	createProcess(reportStacks, STACK_SIZE);
+#endif
 
 	start();
 	return 0;
 }
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Nios II port of smp.h, for the board described there.
+ *
+ * Nios II has no atomic read-modify-write instruction: a spin lock is a
+ * word of memory whose test and set are made while holding the Avalon
+ * mutex core, shared by every lock. The waiting itself is done on the
+ * word, so a core waiting for a lock does not keep the others from the
+ * mutex.
+ */
+#ifdef SMP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <system.h>
+#include <nios2.h>
+#include <sys/alt_irq.h>
+#include <altera_avalon_mutex.h>
+#include <altera_avalon_pio_regs.h>
+
+#include "smp.h"
+#include "interrupt.h"
+
+#ifndef SMP_MUTEX_NAME
+#define SMP_MUTEX_NAME MUTEX_0_NAME
+#endif
+
+static const unsigned int ipi_bases[NUM_CORES] = {SMP_IPI_BASES};
+
+static alt_mutex_dev* mutex = NULL;
+static void (* volatile core_entry)() = NULL;
+static void (*ipi_handler)();
+
+int core_id()
+{
+    int id;
+    NIOS2_READ_CPUID(id);
+    return id;
+}
+
+void spin_lock(SpinLock* lock)
+{
+    /* opened by core 0, before it starts the others */
+    if (mutex == NULL) {
+        mutex = altera_avalon_mutex_open(SMP_MUTEX_NAME);
+        if (mutex == NULL) {
+            fprintf(stderr, "Error: no mutex %s\n", SMP_MUTEX_NAME);
+            exit(1);
+        }
+    }
+    while (1) {
+        /* the value written tells the owner apart, and must not be 0 */
+        altera_avalon_mutex_lock(mutex, core_id() + 1);
+        if (*lock == 0) {
+            *lock = 1;
+            altera_avalon_mutex_unlock(mutex);
+            return;
+        }
+        altera_avalon_mutex_unlock(mutex);
+        while (*lock) {
+            spin_wait();
+        }
+    }
+}
+
+void spin_unlock(SpinLock* lock)
+{
+    *lock = 0;
+}
+
+void spin_wait()
+{
+}
+
+/* Where the BSP starts the cores other than 0: they wait for start_cores
+ * with interrupts masked. */
+void smp_secondary_main()
+{
+    maskInterrupts();
+    while (core_entry == NULL) {
+        spin_wait();
+    }
+    /* registered by core 0, but each core enables its own IRQ lines */
+    alt_irq_enable(SMP_IPI_IRQ);
+    core_entry();
+}
+
+void start_cores(void (*entry)())
+{
+    core_entry = entry;
+}
+
+/* Each core takes the edge of its own PIO */
+static void handle_ipi_interrupts(void* context, alt_u32 id)
+{
+    irq_masked_begin();
+    unsigned int base = ipi_bases[core_id()];
+    IOWR_ALTERA_AVALON_PIO_EDGE_CAP(base, 1);
+    IORD_ALTERA_AVALON_PIO_EDGE_CAP(base);
+    ipi_handler();
+    irq_masked_end();
+}
+
+void init_ipi(void (*handler)())
+{
+    int core;
+    ipi_handler = handler;
+    for (core = 0; core < NUM_CORES; core++) {
+        IOWR_ALTERA_AVALON_PIO_EDGE_CAP(ipi_bases[core], 1);
+        IOWR_ALTERA_AVALON_PIO_IRQ_MASK(ipi_bases[core], 1);
+    }
+    alt_irq_register(SMP_IPI_IRQ, NULL, handle_ipi_interrupts);
+}
+
+/* A rising edge on the output of the PIO of core, looped back to its
+ * edge capture */
+void send_ipi(int core)
+{
+    IOWR_ALTERA_AVALON_PIO_DATA(ipi_bases[core], 1);
+    IOWR_ALTERA_AVALON_PIO_DATA(ipi_bases[core], 0);
+}
+
+#endif
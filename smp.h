@@ -0,0 +1,52 @@
+#ifndef SMP_H_
+#define SMP_H_
+
+/*
+ * Port layer of the multiprocessor build (SMP), NUM_CORES cores sharing
+ * the kernel. smp.c implements it on the board; host/hal_host.c on Linux,
+ * with one thread per core.
+ *
+ * On the board, every core runs the same image. The BSP starts core 0 in
+ * main() and the others in smp_secondary_main(). The cores must see the
+ * memory of the kernel coherently: build them without data cache, or put
+ * the kernel data in memory they do not cache. Each core needs, from the
+ * board:
+ * - the Avalon mutex core SMP_MUTEX_NAME, shared by all of them
+ * - a PIO of its own for its interprocessor interrupts, wired from its
+ *   data output back to its edge capture input; SMP_IPI_BASES lists
+ *   their base addresses, and SMP_IPI_IRQ is their IRQ on each core
+ * - a tightly coupled data memory at the same address on every core,
+ *   holding the .core_local section: the variables of each core
+ */
+#ifndef NUM_CORES
+#define NUM_CORES	2
+#endif
+
+/* Variables with a copy per core */
+#ifndef CORE_LOCAL
+#define CORE_LOCAL	__attribute__((section(".core_local")))
+#endif
+
+/* Core running the caller, from 0 to NUM_CORES - 1. */
+int core_id();
+
+/* Busy waiting lock between the cores. It does not mask interrupts: a
+ * lock an interrupt handler takes must be taken with them masked. */
+typedef volatile int SpinLock;
+
+void spin_lock(SpinLock* lock);
+void spin_unlock(SpinLock* lock);
+
+/* Called in each round of a busy waiting loop. */
+void spin_wait();
+
+/* Runs entry on each of the other cores, with interrupts masked, and
+ * returns on core 0. entry does not return. */
+void start_cores(void (*entry)());
+
+/* Interrupts core, which then calls the handler given to init_ipi as an
+ * interrupt handler. Interrupts sent while one is pending are merged. */
+void send_ipi(int core);
+void init_ipi(void (*handler)());
+
+#endif /*SMP_H_*/
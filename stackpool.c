@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "stackpool.h"
+
+typedef struct {
+	int size;				/* bytes per block */
+	int count;				/* blocks in the class */
+	char* base;				/* first block */
+	unsigned int* freeList;	/* free blocks, linked through their first word */
+	int inUse;
+	int peak;
+} StackClass;
+
+static StackClass stackClasses[STACK_CLASSES] = {
+	{STACK_CLASS_0_SIZE, STACK_CLASS_0_COUNT},
+	{STACK_CLASS_1_SIZE, STACK_CLASS_1_COUNT},
+	{STACK_CLASS_2_SIZE, STACK_CLASS_2_COUNT},
+};
+
+#ifdef STATIC_STACKS
+static char stackArena[STACK_ARENA_SIZE] __attribute__((aligned(16)));
+#endif
+
+static int stackPoolReady = 0;
+
+/* reserve the arena and put every block on the free list of its class */
+static int stackPoolInit() {
+#ifdef STATIC_STACKS
+	char* arena = stackArena;
+#else
+	char* arena = malloc(STACK_ARENA_SIZE);
+	if (arena == NULL) {
+		return 0;
+	}
+#endif
+	int c, i;
+	for (c = 0; c < STACK_CLASSES; ++c) {
+		StackClass* sc = &stackClasses[c];
+		sc->base = arena;
+		sc->freeList = NULL;
+		for (i = sc->count - 1; i >= 0; --i) {
+			unsigned int* block = (unsigned int*)(arena + i * sc->size);
+			*(unsigned int**)block = sc->freeList;
+			sc->freeList = block;
+		}
+		arena += sc->size * sc->count;
+	}
+	stackPoolReady = 1;
+	return 1;
+}
+
+unsigned int* stackAlloc(int size, int* blockSize) {
+	int c;
+	if (!stackPoolReady && !stackPoolInit()) {
+		return NULL;
+	}
+	for (c = 0; c < STACK_CLASSES; ++c) {
+		StackClass* sc = &stackClasses[c];
+		if (sc->size >= size && sc->freeList != NULL) {
+			unsigned int* block = sc->freeList;
+			sc->freeList = *(unsigned int**)block;
+			if (++sc->inUse > sc->peak) {
+				sc->peak = sc->inUse;
+			}
+			*blockSize = sc->size;
+			return block;
+		}
+	}
+	return NULL;
+}
+
+void stackRelease(unsigned int* stack) {
+	int c;
+	for (c = 0; c < STACK_CLASSES; ++c) {
+		StackClass* sc = &stackClasses[c];
+		char* p = (char*)stack;
+		if (p >= sc->base && p < sc->base + sc->size * sc->count) {
+			*(unsigned int**)stack = sc->freeList;
+			sc->freeList = stack;
+			sc->inUse--;
+			return;
+		}
+	}
+}
+
+void stackPoolReport() {
+	int c;
+	int needed = 0;
+	printf("stack class  block size  blocks  in use  peak\n");
+	for (c = 0; c < STACK_CLASSES; ++c) {
+		StackClass* sc = &stackClasses[c];
+		printf("%11d  %10d  %6d  %6d  %4d\n", c, sc->size, sc->count, sc->inUse, sc->peak);
+		needed += sc->size * sc->peak;
+	}
+	printf("arena: %d bytes reserved, %d bytes needed at peak\n", STACK_ARENA_SIZE, needed);
+}
@@ -0,0 +1,61 @@
+#ifndef STACKPOOL_H_
+#define STACKPOOL_H_
+
+/*
+ * Process stacks come from an arena reserved once, split into a few size
+ * classes. Each class is a fixed number of fixed-size blocks kept on a
+ * free list, so allocating and releasing a stack is O(1) and never touches
+ * the heap after the arena is reserved.
+ *
+ * The arena is malloc'd by the first stackAlloc. Built with STATIC_STACKS
+ * it is a static array instead, and the heap is not used at all.
+ *
+ * Class sizes (bytes, multiples of 16, in increasing order) and counts
+ * can be overridden at build time; stackPoolReport gives the counts
+ * actually needed.
+ */
+#ifdef STATIC_CONFIG
+#include "kernelConfig.h"
+#ifndef STATIC_STACKS
+#define STATIC_STACKS
+#endif
+#endif
+
+#ifndef STACK_CLASS_0_SIZE
+#define STACK_CLASS_0_SIZE	2048
+#endif
+#ifndef STACK_CLASS_0_COUNT
+#define STACK_CLASS_0_COUNT	4
+#endif
+#ifndef STACK_CLASS_1_SIZE
+#define STACK_CLASS_1_SIZE	4096
+#endif
+#ifndef STACK_CLASS_1_COUNT
+#define STACK_CLASS_1_COUNT	4
+#endif
+#ifndef STACK_CLASS_2_SIZE
+#define STACK_CLASS_2_SIZE	10240
+#endif
+#ifndef STACK_CLASS_2_COUNT
+#define STACK_CLASS_2_COUNT	8
+#endif
+
+#define STACK_CLASSES		3
+#define STACK_ARENA_SIZE	(STACK_CLASS_0_SIZE * STACK_CLASS_0_COUNT \
+							+ STACK_CLASS_1_SIZE * STACK_CLASS_1_COUNT \
+							+ STACK_CLASS_2_SIZE * STACK_CLASS_2_COUNT)
+
+/* Returns a block of at least size bytes from the smallest class that has
+ * one free, and its actual size in *blockSize; NULL if there is none. */
+unsigned int* stackAlloc(int size, int* blockSize);
+
+/* Gives a block back to its class. Only the first word of the block is
+ * written, so the stack may be released by the process still running on
+ * it, as long as nothing can allocate before it switches away. */
+void stackRelease(unsigned int* stack);
+
+/* Prints the blocks in use and the peak use of each class, and the arena
+ * size that the peaks require. */
+void stackPoolReport();
+
+#endif /*STACKPOOL_H_*/
@@ -3,17 +3,80 @@
 #include "system_m.h"
 #include "assembly.h"
 #include "interrupt.h"
+#include "trace.h"
 
 
-Process running = NULL;  // pointer to the current process.
-Process nextP = NULL;  // variable used internally to implement transfer and iotransfer procedures
+CORE_LOCAL Process running = NULL;  // pointer to the current process.
+static CORE_LOCAL unsigned int* bootContext;  // where the first transfer saves the context of main
+CORE_LOCAL Process nextP = NULL;  // variable used internally to implement transfer and iotransfer procedures
+unsigned int switchCount = 0;  // transfers to another process than the running one, under kernel_lock with SMP
+
+#ifdef SMP
+SpinLock kernel_lock = 0;
+
+/* Process each core switches away from, until its context is saved */
+static volatile Process switchingOut[NUM_CORES];
+
+int transferring(Process p){
+    int core;
+    for(core = 0; core < NUM_CORES; core++){
+        if(switchingOut[core] == p){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Gives up kernel_lock and waits until p is saved, if another core is
+ * switching away from it. Waiting for our own core would never end: the
+ * context we saved last is complete. */
+static void beginTransfer(Process p){
+    int me = core_id();
+    int core;
+    switchingOut[me] = running;
+    spin_unlock(&kernel_lock);
+    for(core = 0; core < NUM_CORES; core++){
+        while(core != me && switchingOut[core] == p){
+            spin_wait();
+        }
+    }
+}
+
+/* The context of the process this core switched away from is saved.
+ * Called once the switch is made, so the per core variables are looked
+ * up again: the caller may have resumed on another core. */
+void finishTransfer(){
+    switchingOut[core_id()] = NULL;
+}
+
+static void endTransfer(){
+    finishTransfer();
+    spin_lock(&kernel_lock);
+}
+#else
+#define beginTransfer(p)
+#define endTransfer()
+#endif
+
+static void countSwitch(Process p){
+    if(p != running){
+        switchCount++;
+        TRACE_SWITCH(p);
+    }
+}
 
 Process newProcess(void (*f), unsigned int* stack, int stackSize){
     
+    return newProcessWithExit(f, NULL, stack, stackSize);
+}
+
+Process newProcessWithExit(void (*f), void (*onExit)(), unsigned int* stack, int stackSize){
+    
     unsigned int* newPC = f;
+    unsigned int* exitPC = (unsigned int*)onExit;
     int size = stackSize - 4;
     
-    Process process = _createStack(stack,newPC,size);
+    Process process = _createStack(stack,newPC,size,exitPC);
     return process;
 }
 
@@ -24,10 +87,26 @@ Process newProcess(void (*f), unsigned int* stack, int stackSize){
 void transfer(Process p){
     
     if(running == NULL){
-        running = malloc(sizeof(Process));
+        running = (Process)&bootContext;
     }
+    countSwitch(p);
     nextP = p ;
+    beginTransfer(p);
     _transfer();
+    endTransfer();
+   
+}
+
+/**
+ * Called from kernel functions, never from an interrupt routine.
+ */
+void ctransfer(Process p){
+    
+    countSwitch(p);
+    nextP = p ;
+    beginTransfer(p);
+    _ctransfer();
+    endTransfer();
    
 }
 
@@ -36,9 +115,16 @@ void transfer(Process p){
  */
 void iotransfer(Process p, int interruptV){
     
-    insertTail(interruptV, running);
+    /* stays valid while we wait: this frame is only left once the
+     * interrupt handler has dequeued us */
+    InterruptWaiter waiter;
+    waiter.p = running;
+    insertTail(interruptV, &waiter);
+    countSwitch(p);
     nextP = p;
-    _transfer();
+    beginTransfer(p);
+    _ctransfer();
+    endTransfer();
    
 }
     
@@ -1,8 +1,22 @@
 #ifndef SYSTEM_M_H_
 #define SYSTEM_M_H_
 
+#include <system.h>
+
+#ifdef SMP
+#include "smp.h"
+#endif
+
+/* Variables with a copy per core; the board has only one */
+#ifndef CORE_LOCAL
+#define CORE_LOCAL
+#endif
+
 typedef unsigned int* Process;
 
+/* The process running on this core. */
+extern CORE_LOCAL Process running;
+
 
 /* 
     newProcess is a procedure that creates a new process. Parameter f denotes the function that constitutes 
@@ -14,12 +28,25 @@ typedef unsigned int* Process;
 
 Process newProcess(void (*f), unsigned int* stack, int stackSize);
 
+/*
+    Same as newProcess, but when f returns the process calls onExit, which must not return.
+ */
+Process newProcessWithExit(void (*f), void (*onExit)(), unsigned int* stack, int stackSize);
+
 /*
    This procedure suspends currently running process and transfers control to process p. 
     
 */
 void transfer(Process p);
 
+/*
+   Same as transfer, for a process that suspends itself from a kernel call
+   rather than from an interrupt routine: only the registers a function call
+   must preserve are saved. Either kind of suspended process can be
+   transferred to with either procedure.
+*/
+void ctransfer(Process p);
+
 
 /*
     This procedure registers that active process waits on interrupt interruptV, suspends active process and
@@ -28,6 +55,29 @@ void transfer(Process p);
  */
 void iotransfer(Process p, int interruptV);
 
+/*
+    Number of transfers to a process other than the running one, by any of the procedures above.
+ */
+extern unsigned int switchCount;
+
+/*
+    Built with SMP, the callers of the three procedures above hold kernel_lock, which they
+    give up while the processes are switched and hold again when they return. A process
+    transferred to for the first time does not return from them: it calls finishTransfer
+    before anything else, and does not hold kernel_lock. A process switched out on one core
+    can resume on another once its context is saved.
+ */
+#ifdef SMP
+extern SpinLock kernel_lock;
+void finishTransfer();
+
+/*
+    Whether a core is still saving the context of process p, after it gave up kernel_lock to
+    switch away from it.
+ */
+int transferring(Process p);
+#endif
+
 
 
 #endif /*SYSTEM_M_H_*/
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include "system.h"
+#include "kernel2.h"
+#include "top.h"
+
+/* processes whose run time is remembered between two tables */
+#ifndef TOP_MAX_PROCESSES
+#define TOP_MAX_PROCESSES	64
+#endif
+
+static int topInterval;
+static unsigned long long lastUptime = 0;
+static unsigned long long lastRunTime[TOP_MAX_PROCESSES];
+
+static double percent(unsigned long long part, unsigned long long whole) {
+	return whole == 0 ? 0.0 : 100.0 * part / whole;
+}
+
+void printTop() {
+	KernelStats kernel;
+	ProcessStats stats;
+	int pid;
+
+	getKernelStats(&kernel);
+	unsigned long long interval = kernel.uptime - lastUptime;
+	lastUptime = kernel.uptime;
+
+	printf("up %llu.%03llu s, idle %.1f%%, ticks %.1f%%, %u switches, %u preemptions, %u clock interrupts\n",
+			kernel.uptime / 1000000, kernel.uptime / 1000 % 1000,
+			percent(kernel.idleTime, kernel.uptime * kernel.cores),
+			percent(kernel.tickTime, kernel.uptime),
+			kernel.switches, kernel.preemptions, kernel.clockInterrupts);
+	if (kernel.cores > 1) {
+		printf("%d cores, %u steals, %u interrupts between cores\n", kernel.cores, kernel.steals, kernel.kicks);
+	}
+#ifdef IRQ_LATENCY
+	printf("longest interrupt-disabled window %u us\n", irq_masked_max() / (TIMER_FREQ / 1000000));
+#endif
+	printf("  PID  PRI   %%CPU     RUN ms   READY ms MONITOR ms      VOL    INVOL%s\n",
+			kernel.cores > 1 ? " CORE" : "");
+	for (pid = 0; pid < kernel.processes; ++pid) {
+		if (!getProcessStats(pid, &stats)) {
+			continue;
+		}
+		double cpu = 0.0;
+		if (pid < TOP_MAX_PROCESSES) {
+			/* a pid reused since the last table starts over */
+			unsigned long long last = lastRunTime[pid] <= stats.runTime ? lastRunTime[pid] : 0;
+			cpu = percent(stats.runTime - last, interval);
+			lastRunTime[pid] = stats.runTime;
+		}
+		char priority[12];
+		if (stats.priority < 0) {
+			snprintf(priority, sizeof(priority), "EDF");
+		} else {
+			snprintf(priority, sizeof(priority), "%d", stats.priority);
+		}
+		char core[16] = "";
+		if (kernel.cores > 1) {
+			snprintf(core, sizeof(core), " %4d", stats.core);
+		}
+		printf("%5d %4s %6.1f %10llu %10llu %10llu %8u %8u%s%s\n", pid, priority, cpu, stats.runTime / 1000, stats.readyTime / 1000, stats.monitorTime / 1000,
+				stats.voluntarySwitches, stats.involuntarySwitches, core,
+				pid >= kernel.idlePid && pid < kernel.idlePid + kernel.cores ? "  idle" : "");
+	}
+}
+
+static void topCode() {
+	while (1) {
+		sleep(topInterval);
+		printTop();
+	}
+}
+
+int createTopProcess(int stackSize, int msec) {
+	topInterval = msec;
+	return createProcess(topCode, stackSize);
+}
@@ -0,0 +1,12 @@
+#ifndef TOP_H_
+#define TOP_H_
+
+/* Creates a process that prints the CPU accounting of the kernel and of
+ * every process, in the manner of top, every msec ms. %CPU is measured
+ * over the last interval. Returns the pid of the process. */
+int createTopProcess(int stackSize, int msec);
+
+/* Prints the table once; %CPU is measured since the previous call. */
+void printTop();
+
+#endif /*TOP_H_*/
@@ -0,0 +1,58 @@
+#include <system.h>
+#include "trace.h"
+#include "interrupt.h"
+
+#if TRACE_CATEGORIES
+
+static TraceRecord traceBuffer[TRACE_BUFFER_SIZE];
+static unsigned int traceHead = 0;		/* records written so far */
+static unsigned int traceProcesses[TRACE_MAX_PROCESSES];
+static volatile int traceFrozen = 0;	/* set while trace_dump writes the buffer */
+
+void trace_record(int type, int id, unsigned int arg) {
+	if (traceFrozen) {
+		return;
+	}
+	TraceRecord* r = &traceBuffer[traceHead & (TRACE_BUFFER_SIZE - 1)];
+	r->time = clock_timestamp();
+	r->type = type;
+	r->id = id;
+	r->arg = arg;
+	traceHead++;
+}
+
+void trace_create(int pid, Process p) {
+	if (pid < TRACE_MAX_PROCESSES) {
+		traceProcesses[pid] = TRACE_PROCESS_ARG(p);
+	}
+	trace_record(TRACE_EV_CREATE, pid, TRACE_PROCESS_ARG(p));
+}
+
+void trace_dump(FILE* f) {
+	TraceHeader header;
+	unsigned int first, i;
+
+	/* the buffer is frozen, rather than interrupts masked, while it is
+	 * written out: the records of that time are lost */
+	int state = saveInterrupts();
+	traceFrozen = 1;
+	header.magic = TRACE_MAGIC;
+	header.version = TRACE_VERSION;
+	header.frequency = TIMER_FREQ;
+	header.processes = TRACE_MAX_PROCESSES;
+	header.count = traceHead < TRACE_BUFFER_SIZE ? traceHead : TRACE_BUFFER_SIZE;
+	header.lost = traceHead - header.count;
+	restoreInterrupts(state);
+
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(traceProcesses, sizeof(traceProcesses), 1, f);
+
+	first = traceHead - header.count;
+	for (i = first; i != traceHead; ++i) {
+		fwrite(&traceBuffer[i & (TRACE_BUFFER_SIZE - 1)], sizeof(TraceRecord), 1, f);
+	}
+	fflush(f);
+	traceFrozen = 0;
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdio.h>
+#include "system_m.h"
+
+/*
+ * Binary kernel trace. Records of 12 bytes go to a static ring that keeps
+ * the last TRACE_BUFFER_SIZE of them; nothing is allocated or printed
+ * while tracing. trace_dump writes the ring to a file, and
+ * host/trace2json turns that file into Chrome trace (Perfetto) JSON.
+ *
+ * Categories are selected at build time with TRACE_CATEGORIES, e.g.
+ * -DTRACE_CATEGORIES=TRACE_ALL. The macros of a disabled category expand
+ * to nothing, and with no category neither the ring nor the code exist.
+ */
+#define TRACE_SWITCHES		1	/* context switches and process creation */
+#define TRACE_MONITORS		2	/* enter, exit, wait and notify */
+#define TRACE_TIMEOUTS		4	/* expired sleep and timed wait timeouts */
+#define TRACE_INTERRUPTS	8	/* interrupt handler entry and exit */
+#define TRACE_ALL			15
+
+#ifndef TRACE_CATEGORIES
+#define TRACE_CATEGORIES	0
+#endif
+
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE	1024	/* records, power of two */
+#endif
+
+/* Processes whose current Process value is kept apart from the ring, so
+ * that switches can be decoded once their creation has been overwritten */
+#ifndef TRACE_MAX_PROCESSES
+#define TRACE_MAX_PROCESSES	32
+#endif
+
+/* Record types */
+#define TRACE_EV_CREATE		1	/* id: pid, arg: its Process */
+#define TRACE_EV_SWITCH		2	/* arg: Process switched to */
+#define TRACE_EV_MON_ENTER	3	/* id: monitor, arg: pid; monitor taken */
+#define TRACE_EV_MON_BLOCK	4	/* monitor busy, pid queued on entry */
+#define TRACE_EV_MON_EXIT	5
+#define TRACE_EV_MON_WAIT	6
+#define TRACE_EV_MON_NOTIFY	7
+#define TRACE_EV_MON_NOTIFY_ALL	8
+#define TRACE_EV_TIMEOUT	9	/* id: pid */
+#define TRACE_EV_IRQ_ENTER	10	/* id: interrupt device */
+#define TRACE_EV_IRQ_EXIT	11
+
+typedef struct {
+	unsigned int time;		/* clock_timestamp() */
+	unsigned short type;	/* TRACE_EV_* */
+	unsigned short id;
+	unsigned int arg;
+} TraceRecord;
+
+/* Header of a dumped trace, followed by the Process values of pids 0 to
+ * processes - 1 (0 if unused), then by count records, oldest first. All
+ * fields are little endian, as on both Nios II and x86. */
+#define TRACE_MAGIC			0x4352544b	/* "KTRC" */
+#define TRACE_VERSION		1
+
+typedef struct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int frequency;	/* timestamp counts per second */
+	unsigned int processes;
+	unsigned int count;
+	unsigned int lost;		/* older records overwritten */
+} TraceHeader;
+
+#if TRACE_CATEGORIES
+
+/* Appends a record; called by the kernel calls, between saveInterrupts
+ * and restoreInterrupts, and by the interrupt handlers. Records made
+ * while trace_dump runs are dropped. */
+void trace_record(int type, int id, unsigned int arg);
+
+/* Records the creation of process pid. */
+void trace_create(int pid, Process p);
+
+/* Writes the header and the records to f, which should be opened in
+ * binary mode. The buffer is frozen while the records are written, with
+ * interrupts allowed; the events of that time are not recorded. */
+void trace_dump(FILE* f);
+
+#define TRACE_PROCESS_ARG(p)	((unsigned int)(unsigned long)(p))
+
+#else
+
+#define trace_dump(f)		((void)0)
+
+#endif
+
+#if TRACE_CATEGORIES & TRACE_SWITCHES
+#define TRACE_CREATE(pid, p)	trace_create(pid, p)
+#define TRACE_SWITCH(p)			trace_record(TRACE_EV_SWITCH, 0, TRACE_PROCESS_ARG(p))
+#else
+#define TRACE_CREATE(pid, p)	((void)0)
+#define TRACE_SWITCH(p)			((void)0)
+#endif
+
+#if TRACE_CATEGORIES & TRACE_MONITORS
+#define TRACE_MONITOR(type, monitor, pid)	trace_record(type, monitor, pid)
+#else
+#define TRACE_MONITOR(type, monitor, pid)	((void)0)
+#endif
+
+#if TRACE_CATEGORIES & TRACE_TIMEOUTS
+#define TRACE_TIMEOUT(pid)		trace_record(TRACE_EV_TIMEOUT, pid, 0)
+#else
+#define TRACE_TIMEOUT(pid)		((void)0)
+#endif
+
+#if TRACE_CATEGORIES & TRACE_INTERRUPTS
+#define TRACE_IRQ_ENTER(device)	trace_record(TRACE_EV_IRQ_ENTER, device, 0)
+#define TRACE_IRQ_EXIT(device)	trace_record(TRACE_EV_IRQ_EXIT, device, 0)
+#else
+#define TRACE_IRQ_ENTER(device)	((void)0)
+#define TRACE_IRQ_EXIT(device)	((void)0)
+#endif
+
+#endif /*TRACE_H_*/